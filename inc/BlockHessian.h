@@ -0,0 +1,72 @@
+#pragma once
+/*
+*   The matrix of a backward Euler step over the moving particles,
+*
+*       M + deltaT (C + airDampening I) + deltaT^2 H
+*
+*   with H the springs' energy Hessian and C their dampening, stored as
+*   3x3 blocks in compressed rows. Springs never change after a scene is
+*   built, so neither does where their blocks land: setScene works out the
+*   pattern once, with each row's springs and the slot each one's
+*   off-diagonal block goes to, and assemble only writes numbers into
+*   blocks that already exist. It computes every spring's block in
+*   parallel, then every row sums its own springs' blocks, so no two
+*   threads write the same block and nothing is allocated.
+*/
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Spring.h"
+#include "ThreadPool.h"
+
+class BlockHessian
+{
+    public:
+        static constexpr size_t STATIC = SIZE_MAX;
+
+        // pool runs the assembly and products, must outlive the matrix
+        explicit BlockHessian(ThreadPool& pool);
+
+        void setScene(const std::vector<Particle>& particles, const std::vector<Spring>& springs);
+
+        /*
+            Fills in the blocks at the particles' current positions. A spring's
+            Hessian is k (d d^T + (1 - restLength / length) (I - d d^T)) along its
+            direction d, with the second term left out while it's compressed so
+            the matrix stays positive definite.
+        */
+        void assemble(const std::vector<Particle>& particles, const std::vector<Spring>& springs,
+                      float airDampening, float deltaT);
+
+        // result = A x, both per row
+        void multiply(const std::vector<glm::dvec3>& x, std::vector<glm::dvec3>& result) const;
+
+        size_t rows() const { return particleIndices.size(); }
+        size_t getBlockCount() const { return blocks.size(); }
+        const glm::dmat3& diagonalBlock(size_t row) const { return blocks[diagonalSlots[row]]; }
+        size_t particleOf(size_t row) const { return particleIndices[row]; }
+        size_t rowOf(size_t particle) const { return unknowns[particle]; }
+
+    private:
+        const size_t MIN_CHUNK = 256;
+
+        struct Incidence
+        {
+            unsigned int spring;
+            size_t slot;                        // the block coupling this row to the spring's other end, or STATIC
+        };
+
+        ThreadPool& pool;
+
+        std::vector<size_t> unknowns;           // per particle, its row or STATIC
+        std::vector<size_t> particleIndices;    // per row, its particle
+        std::vector<size_t> rowStarts;          // row r's blocks are blocks[rowStarts[r], rowStarts[r + 1])
+        std::vector<size_t> columns;            // per block, its column
+        std::vector<glm::dmat3> blocks;
+        std::vector<size_t> diagonalSlots;      // per row
+        std::vector<size_t> incidenceStarts;    // row r's springs are incidences[incidenceStarts[r], incidenceStarts[r + 1])
+        std::vector<Incidence> incidences;
+        std::vector<glm::dmat3> springBlocks;   // per spring, deltaT^2 H + deltaT C of its own
+};
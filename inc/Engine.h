@@ -4,12 +4,26 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "Spring.h"
+#include "Quantize.h"
 #include "Shader.h"
 #include "VertexArray.h"
 #include "Camera.h"
+#include "SurfaceMesh.h"
+#include "Solver.h"
+#include "ImplicitSolver.h"
+#include "ProjectiveSolver.h"
+#include "ThreadPool.h"
+#include "FrameTimer.h"
+#include "OffscreenContext.h"
+#include "FrameCapture.h"
+#include "SceneFile.h"
+#include "TrajectoryRecorder.h"
+#include "TrajectoryPlayer.h"
+#include "SharedState.h"
 
 class Engine
 {
@@ -31,28 +45,157 @@ class Engine
             SingleSpring,
             MultipleSprings,
             Jello,
-            Curtain
+            Curtain,
+            FileScene           // loaded from sceneFile, after the built in ones
+        };
+
+        // Subsets of the springs drawn as lines, from every spring to the fewest.
+        // Each level only drops springs from the one before it.
+        enum LodLevel
+        {
+            AllSprings,
+            SurfaceSprings,         // springs lying in the surface, no interior ones
+            StructuralSprings,      // surface springs along grid lines, no diagonals
+            DecimatedSprings,       // every other structural grid line
+            LOD_LEVELS
+        };
+
+        enum LodMode
+        {
+            LodByDistance,          // coarser as the object covers less of the screen
+            LodByFrameBudget,       // coarser while frames take longer than lodBudget
+            LodFixed                // always lodLevel
+        };
+
+        // How particle positions are sent to the GPU every frame
+        enum UploadMode
+        {
+            FullFloat,          // 3 floats per particle
+            Quantized16         // 3 unsigned shorts per particle relative to the frame's bounding box
         };
 
         typedef std::unique_ptr<GLFWwindow, DestroyglfwWin> GLFWwindowPtr;
         GLFWwindowPtr window_;
         bool windowInitialized_;
+        bool argumentsValid_ = true;
+        // declared before every GL object so the context outlives them
+        bool headless = false;                          // no window, render into offscreenContext
+        OffscreenContext offscreenContext;
+        std::unique_ptr<FrameCapture> frameCapture;     // null unless --capture was given
+        std::string capturePath;
+        FrameCapture::Format captureFormat = FrameCapture::Format::PNG;
+        uint frameLimit = 0;                            // 0 runs until the window closes
+        const uint BENCHMARK_FRAMES = 1000;             // without --frames
+        const uint HEADLESS_FRAMES = 600;               // without --frames or --benchmark, ten seconds of simulation
+        uint framesRendered = 0;
+
+        bool benchmark = false;                         // no vsync, fixed frame count, frame statistics on exit
+        uint presentInterval = 1;                       // swap buffers every this many frames
+        const uint BENCHMARK_WARMUP = 30;               // frames left out of the statistics
         // std::vector< std::shared_ptr<VertexArray> > vertexArrays;
         std::shared_ptr<Shader> shader;
         std::shared_ptr<VertexArray> vertexArray;
+        std::shared_ptr<Shader> impostorShader;
+        std::shared_ptr<VertexArray> impostorVertexArray;   // instanced view of vertexArray's positions
         Camera camera;
 
         uint currentScene = 0;              // starts at index 0
-        const uint TOTAL_SCENES = 4;    
+        const uint TOTAL_SCENES = 4;        // built in
+        std::string sceneFile;              // a .scene file, or a mesh for MeshImport
+        std::string exportPrefix;           // export the built in scenes and exit
+        uint gridSize = 0;                  // particles along each edge of Jello and Curtain, 0 keeps theirs
         bool rightKeyHeld = false;
         bool leftKeyHeld = false;
         bool rKeyHeld = false;
+        bool qKeyHeld = false;
+        bool iKeyHeld = false;
+        bool sKeyHeld = false;
+        bool lKeyHeld = false;
+        bool tKeyHeld = false;
+        bool cKeyHeld = false;
+        bool spaceKeyHeld = false;
+        bool bKeyHeld = false;
+        bool upKeyHeld = false;
+        bool downKeyHeld = false;
 
 	    std::vector<uint> indicies;        
         std::vector<Spring> springs;
         std::vector<Particle> particles;
+        double simulationTime = 0;                      // seconds since the scene was built
+        std::vector<Particle> resetParticles;           // particles as the scene was built, R restores them
+        double resetTime = 0;
         std::vector<float> particlePositions;
+        std::vector<unsigned short> quantizedPositions;
+
+        UploadMode uploadMode = UploadMode::FullFloat;
+        glm::vec3 positionOffset = glm::vec3(0);        // decodes quantized positions in the vertex shader
+        glm::vec3 positionScale = glm::vec3(1);
+        Bounds positionBounds = {};                     // of the last upload, when quantizing or picking a LOD by distance
+
+        bool drawImpostors = false;                     // shaded spheres instead of GL_POINTS
+        float particleRadius = 0.02f;
+
+        bool drawSurface = false;                       // lit triangles instead of every spring
+        SurfaceMesh surfaceMesh;                        // empty for scenes without a surface
+        std::shared_ptr<Shader> surfaceShader;
+        std::shared_ptr<VertexArray> surfaceVertexArray;
 
+        ThreadPool threadPool;
+
+        std::string checkpointPath = "checkpoint.scene";    // a scene file, load it with --scene to resume
+        uint checkpointInterval = 0;                    // in frames, 0 only writes when C is pressed
+        ThreadPool checkpointWriter{1};
+
+        std::unique_ptr<TrajectoryRecorder> trajectoryRecorder;    // null unless --record was given
+        std::string recordPath;
+        uint recordInterval = 0;                        // in substeps, 0 records once a frame
+        uint substepsSinceRecord = 0;
+        float recordStep = 1e-4f;                       // position quantization
+
+        std::unique_ptr<TrajectoryPlayer> trajectoryPlayer;        // null unless --play was given, replaces the physics
+        std::string playPath;
+        float playbackSpeed = 1;                        // 1 is real time, negative plays backwards
+        double playhead = 0;                            // in recorded frames
+        bool playbackPaused = false;
+        int scrubDirection = 0;                         // -1 or 1 while Left or Right is held
+
+        SharedStatePublisher statePublisher;            // live positions for other processes, see --publish
+        std::string publishName;
+        SharedStateReader stateReader;                  // replaces the physics with another process's positions
+        std::string viewName;
+        double lastAttachAttempt = -1;
+
+        std::vector<float> externalPositions;           // from trajectoryPlayer or stateReader
+
+        std::string ensembleFile;                       // instances to run side by side without a window, see Ensemble
+        double ensembleSeconds = 10;                    // simulated
+        std::string ensembleOutput;                     // CSV, stdout when empty
+
+        std::string sweepFile;                          // parameter ranges to run every combination of, see Sweep
+        std::string sweepOutput;                        // CSV, stdout when empty
+
+        // indicies is sorted coarsest level first, so every level draws a prefix of it
+        size_t lodIndexCounts[LOD_LEVELS] = {};
+        LodMode lodMode = LodMode::LodFixed;           // every spring unless --lod or --lod-budget
+        uint lodLevel = LodLevel::AllSprings;
+        float lodBudget = 1000.0f / 60;                 // in milliseconds
+        double lastFrameStart = 0;
+        float frameTime = 0;                            // of the previous frame, in milliseconds
+
+        FrameTimer frameTimer;
+        bool showTimings = false;                       // on screen bars and window title
+        bool printTimingSummary = false;                // on exit
+        double lastTitleUpdate = 0;
+        std::shared_ptr<Shader> overlayShader;
+        std::shared_ptr<VertexArray> overlayVertexArray;
+        std::vector<float> overlayVertices;
+
+        bool printGLStats = false;                      // GL calls per frame, see GLState
+        uint statFrames = 0;
+        uint statCallsIssued = 0;
+        uint statCallsSkipped = 0;
+
+        bool groundCollider = false;                    // particles bounce off the ground
         std::vector<float> groundVertices;
         std::vector<uint> groundIndices;
         std::shared_ptr<VertexArray> groundVertexArray;
@@ -60,19 +203,61 @@ class Engine
         const float EPSILON = 1E-5;
         float deltaT = 0.0001;                               // in miliseconds
         uint updatesPerFrame = (1.0f / 60) / deltaT;
+        bool autoTimestep = false;                      // pick deltaT per scene, see chooseTimestep
+        float timestepSafety = 0.5;                     // fraction of the stable timestep used
         glm::vec3 gravityForce = glm::vec3(0, -9.81f, 0);
         float airDampening = 0.0001;
+        std::unique_ptr<Solver> solver = std::make_unique<ExplicitSolver>();
+        AdaptiveSolver* adaptiveSolver = nullptr;       // owned by solver with --adaptive
+        uint xpbdIterations = 0;                        // --xpbd, 0 leaves the solver alone
+        float xpbdTolerance = 0;
+        uint implicitIterations = 0;                    // --implicit, conjugate gradient iterations per step
+        double cgTolerance = 1E-4;
+        NewtonOptions newtonOptions;                    // --newton, implies --implicit 200 if it isn't given
+        uint pdIterations = 0;                          // --pd, 0 leaves the solver alone
+        double pdTolerance = 0;
+        ProjectiveSolver::GlobalStep pdGlobalStep = ProjectiveSolver::Cholesky;
+        MultigridOptions multigridOptions;
+        ParticleGrid particleGrid;                      // set by the Jello and Curtain builders
 
+        bool parseArguments(int argc, const char* argv[]);       // false on options that contradict each other
         bool initWindow();
+        bool initHeadless();
+        bool running() const;
+        bool runEnsemble();
+        bool runSweep();
         void initScene();
+        void buildScene();
+        void chooseTimestep();
+        void initBuffers();
         void initSingleSpringScene();
         void initMultipleSpringsScene();
         void initJelloScene();
         void initCurtainScene();
+        void initFileScene();
+        void initGround(float height, float halfExtent);
+        bool exportScenes();
+        SceneData sceneData() const;
+        void saveCheckpoint();
+        void resetScene();
+        void stopRecording();
+        void initPlayback();
         void processInput();
         void update();
-        void checkCollisions(Particle& particle);
+        void simulate();
+        SimulationParams simulationParams() const;
+        void updatePlayback();
+        void updateView();
+        void setUploadMode(UploadMode mode);
+        void uploadPositions();
         void render();        
-
-        glm::vec3 calcSpringForce(const Spring& spring);
+        void updateGLStats();
+        void initOverlay();
+        void renderOverlay();
+        void updateTimingTitle();
+        void selectLod();
+        void sortSpringLods(const std::vector<uint>& springLevels);
+        uint gridSpringLod(glm::uvec3 a, glm::uvec3 b, glm::uvec3 last) const;
+        void renderImpostors();
+        void renderSurface();
 };
\ No newline at end of file
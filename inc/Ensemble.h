@@ -0,0 +1,95 @@
+#pragma once
+/*
+*   Runs many copies of one scene side by side, each with its own spring
+*   stiffness and dampening, for parameter studies without a process per
+*   run. The copies share the scene's topology, so their state is stored
+*   instance innermost, in groups of LANES instances:
+*
+*       group g, particle p, lane l  ->  [(g * particleCount + p) * LANES + l]
+*
+*   Every loop over lanes has a fixed length and no dependencies between
+*   lanes, so the compiler turns it into a few vector instructions, which is
+*   what makes tiny scenes cheap. Groups never touch each other, so each
+*   one runs all of its steps as a single task on the thread pool. With
+*   fewer groups than threads that would leave threads idle, so instead
+*   every step is split over the springs and then the particles of all
+*   the groups. The springs' forces go to a buffer of their own, and each
+*   particle sums its springs' in the order a single task would have, so
+*   the results are the same either way.
+*/
+
+#include <glm/glm.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Solver.h"
+#include "Spring.h"
+#include "ThreadPool.h"
+
+struct EnsembleInstance
+{
+    float stiffnessScale = 1;           // multiplies every spring's stiffness
+    float dampeningScale = 1;           // multiplies every spring's dampening
+};
+
+struct EnsembleResult
+{
+    bool stable;                        // every position and velocity is still finite
+    float kineticEnergy;
+    glm::vec3 centreOfMass;             // of the particles that move
+    float maxSpeed;
+};
+
+class Ensemble
+{
+    public:
+        static const size_t LANES = 8;
+
+        Ensemble(const std::vector<Particle>& particles, const std::vector<Spring>& springs,
+                 const std::vector<EnsembleInstance>& instances);
+
+        void setParams(const SimulationParams& params) { this->params = params; }
+
+        // Advances every instance by steps of params.deltaT, the same steps ExplicitSolver takes
+        void run(size_t steps, ThreadPool& pool);
+
+        std::vector<EnsembleResult> getResults() const;
+        void writeResults(std::ostream& out) const;       // CSV, one row per instance
+
+        /*
+            Reads one instance per line, "stiffnessScale dampeningScale". Blank
+            lines and lines starting with # are skipped.
+        */
+        static bool loadInstances(const std::string& path, std::vector<EnsembleInstance>& instances);
+
+    private:
+        const float EPSILON = 1E-5;     // matches ExplicitSolver
+        const size_t MIN_CHUNK = 256;   // springs or particles, when a step is split across the pool
+
+        std::vector<EnsembleInstance> instances;
+        std::vector<Spring> springs;
+        std::vector<float> masses;
+        std::vector<float> weights;
+        size_t particleCount;
+        size_t groups;
+
+        // lane state, laid out as described above
+        std::vector<float> px, py, pz;
+        std::vector<float> vx, vy, vz;
+        std::vector<float> fx, fy, fz;
+        std::vector<float> stiffnessScales;     // [g * LANES + l]
+        std::vector<float> dampeningScales;
+
+        // per particle, the springs it's an end of as spring * 2 + end, end 0 being p1
+        std::vector<size_t> incidenceStarts;
+        std::vector<size_t> incidences;
+        std::vector<float> springFx, springFy, springFz;   // [(g * springCount + s) * LANES + l], when split
+
+        SimulationParams params;
+
+        void step(size_t group);
+        void stepSplit(ThreadPool& pool);
+        void springForce(size_t group, const Spring& spring, float* forceX, float* forceY, float* forceZ) const;
+        void moveParticle(size_t group, size_t particle);
+};
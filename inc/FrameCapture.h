@@ -0,0 +1,82 @@
+#pragma once
+/*
+*   Reads rendered frames back through a ring of pixel buffer objects and
+*   hands them to writer threads. glReadPixels into a bound pixel pack
+*   buffer returns immediately; the buffer is only mapped a few frames
+*   later, once its fence has signalled, so rendering doesn't wait on the
+*   readback. At most a couple of frames per writer thread wait to be
+*   written; past that capture blocks until one is done, so writers that
+*   can't keep up slow the render loop down instead of piling up frames
+*   in memory.
+*/
+
+#include <glad/glad.h>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+
+class FrameCapture
+{
+    public:
+        enum Format
+        {
+            PPM,        // one binary PPM per frame
+            PNG,        // one uncompressed PNG per frame
+            Y4M         // a single YUV 4:2:0 video stream
+        };
+
+        /*
+            parameters:
+                path:           Per frame formats append _<frame>.<ext>, Y4M appends .y4m
+                writerThreads:  Threads encoding and writing frames
+        */
+        FrameCapture(int width, int height, Format format, const std::string& path, unsigned int writerThreads = 2);
+        ~FrameCapture();        // finishes every frame still in flight
+
+        FrameCapture(const FrameCapture&) = delete;
+        FrameCapture& operator=(const FrameCapture&) = delete;
+
+        void capture();         // queues a readback of the bound read framebuffer
+        void finish();          // blocks until every captured frame is on disk
+
+        unsigned int getStalls() const { return stalls; }     // times a readback was not ready in time
+
+        static bool parseFormat(const std::string& name, Format& format);
+
+    private:
+        static const unsigned int RING_SIZE = 3;
+        static const unsigned int FRAMES_PER_WRITER = 2;       // queued or being written, at most
+
+        int width, height;
+        Format format;
+        std::string path;
+
+        GLuint pixelBuffers[RING_SIZE] = {};
+        GLsync fences[RING_SIZE] = {};
+        unsigned int framesInRing[RING_SIZE] = {};
+        unsigned int nextSlot = 0;
+        unsigned int framesCaptured = 0;
+        unsigned int stalls = 0;
+
+        ThreadPool writers;
+        unsigned int maxFramesQueued;
+        unsigned int framesQueued = 0;
+        std::mutex queueMutex;
+        std::condition_variable frameWritten;
+        FILE* stream = nullptr;                 // for Y4M
+        std::mutex streamMutex;
+        std::condition_variable streamTurn;
+        unsigned int nextStreamFrame = 0;       // frames are encoded in parallel but appended in order
+
+        bool retire(unsigned int slot, bool wait);
+        void write(unsigned int frame, std::shared_ptr< std::vector<unsigned char> > rgba);
+        void writePPM(unsigned int frame, const std::vector<unsigned char>& rgba);
+        void writePNG(unsigned int frame, const std::vector<unsigned char>& rgba);
+        void writeY4M(unsigned int frame, const std::vector<unsigned char>& rgba);
+        std::string framePath(unsigned int frame, const char* extension) const;
+};
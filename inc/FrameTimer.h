@@ -0,0 +1,77 @@
+#pragma once
+/*
+*   Times named sections of a frame on the CPU with a steady clock and on
+*   the GPU with GL_TIME_ELAPSED queries. GPU results are read a few frames
+*   later, only once the driver reports them available, so timing never
+*   waits on the GPU.
+*/
+
+#include <glad/glad.h>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class FrameTimer
+{
+    public:
+        struct Section
+        {
+            std::string name;
+            bool gpu;
+            double averageMs = 0;       // smoothed over recent frames
+            double totalMs = 0;
+            double maxMs = 0;
+            unsigned int samples = 0;
+        };
+
+        FrameTimer() {}
+        ~FrameTimer();
+
+        FrameTimer(const FrameTimer&) = delete;
+        FrameTimer& operator=(const FrameTimer&) = delete;
+
+        void beginFrame();              // collects finished GPU results
+        void endFrame();                // records the whole frame's CPU time
+
+        // GPU sections must not overlap each other, CPU sections may
+        void beginGpu(const std::string& name);
+        void endGpu();
+        void beginCpu(const std::string& name);
+        void endCpu(const std::string& name);
+
+        const std::vector<Section>& getSections() const { return sections; }
+        double getFrameMs() const { return frame.averageMs; }
+        void printSummary(std::ostream& out) const;
+
+        // keeps every frame's time from now on, for printFrameStatistics
+        void keepFrameTimes(bool keep) { keepingFrameTimes = keep; }
+        void printFrameStatistics(std::ostream& out) const;    // min / mean / median / p95 / max
+
+    private:
+        static const unsigned int LATENCY = 4;     // frames a GPU query may take before its slot is reused
+
+        typedef std::chrono::steady_clock Clock;
+
+        struct GpuQueries
+        {
+            GLuint ids[LATENCY] = {};
+            bool pending[LATENCY] = {};
+        };
+
+        std::vector<Section> sections;
+        std::vector<GpuQueries> queries;            // parallel to sections, unused for CPU sections
+        std::vector<Clock::time_point> cpuStarts;   // parallel to sections
+        Section frame;
+        std::vector<double> frameTimes;
+        bool keepingFrameTimes = false;
+        Clock::time_point frameStart;
+        bool frameStarted = false;
+        unsigned int frameIndex = 0;
+        int activeGpuSection = -1;
+        bool flushSections = false;                 // see findSection
+
+        size_t findSection(const std::string& name, bool gpu);
+        void addSample(Section& section, double ms);
+        void collect(size_t section, unsigned int slot);
+};
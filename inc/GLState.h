@@ -0,0 +1,40 @@
+#pragma once
+/*
+*   Remembers which vertex array, buffers and program are bound so that
+*   binding the same object twice in a row never reaches the driver.
+*   All binds in the program go through here, which keeps the cache
+*   truthful. There is only ever one context, so the state is static.
+*/
+
+#include <glad/glad.h>
+#include <unordered_map>
+
+class GLState
+{
+    public:
+        struct Counters
+        {
+            unsigned int issued = 0;        // calls that reached the driver
+            unsigned int skipped = 0;       // binds dropped because the object was already bound
+        };
+
+        static void bindVertexArray(GLuint id);
+        static void bindBuffer(GLenum target, GLuint id);
+        static void useProgram(GLuint id);
+
+        // deleting a bound object unbinds it, so the cache has to know
+        static void deleteVertexArray(GLuint id);
+        static void deleteBuffer(GLuint id);
+        static void deleteProgram(GLuint id);
+
+        static void countCalls(unsigned int calls = 1);     // for every other call made each frame: draws, clears, uniforms, uploads, queries
+
+        static Counters endFrame();     // returns the counters since the last call and resets them
+
+    private:
+        static GLuint vertexArray;
+        static GLuint arrayBuffer;
+        static GLuint program;
+        static std::unordered_map<GLuint, GLuint> elementBuffers;   // the element buffer is vertex array state
+        static Counters counters;
+};
@@ -0,0 +1,109 @@
+#pragma once
+/*
+*   Linearized backward Euler: the springs' forces at the end of the step
+*   are taken as their forces now plus their Hessian times how far the
+*   particles move, which leaves the linear system
+*
+*       (M + deltaT (C + airDampening I) + deltaT^2 H) v' = M v + deltaT f
+*
+*   for the new velocities v', with f the spring and gravity forces at the
+*   current positions. It's stable at a whole frame per step and damps
+*   more the longer the step. The matrix is assembled into a BlockHessian
+*   and solved by conjugate gradients, preconditioned by the inverse of
+*   each particle's 3x3 diagonal block. Spring dampening here resists how
+*   fast a spring stretches, linearly, so it goes into the matrix too.
+*
+*   With Newton iterations the step is solved exactly instead, as the
+*   positions that minimize the incremental potential
+*
+*       1/2 |x - x~|^2_M + deltaT^2 (springs' energy - M g . x) + dampening
+*
+*   where x~ is where momentum alone would take the particles. Each
+*   iteration solves the same kind of system for a direction and backtracks
+*   along it until the potential drops enough, which only a stretch the
+*   Hessian mispredicts needs. The linearization's error is what made it
+*   lose energy, so this keeps large steps from damping any more than
+*   backward Euler does on its own.
+*
+*   Either way the step starts from the last step's change in velocity
+*   carried on, and conjugate gradients stops at a residual relative to
+*   the right hand side, so a start that's already close costs fewer
+*   iterations.
+*/
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "BlockHessian.h"
+#include "Solver.h"
+#include "ThreadPool.h"
+
+struct NewtonOptions
+{
+    unsigned int iterations = 0;            // 0 takes one linearized step instead
+    double tolerance = 1E-3;                // stop once no velocity would change by more, in m/s
+    unsigned int lineSearchSteps = 20;      // halvings before giving up on a direction
+};
+
+class ImplicitSolver : public Solver
+{
+    public:
+        /*
+            parameters:
+                maxIterations:  Conjugate gradient iterations per solve at most
+                pool:           Runs the assembly and the solve, must outlive the solver
+                tolerance:      Residual to stop at, relative to the right hand side's
+        */
+        ImplicitSolver(unsigned int maxIterations, ThreadPool& pool, double tolerance = 1E-4,
+                       const NewtonOptions& newton = NewtonOptions());
+
+        void setScene(const std::vector<Particle>& particles, const std::vector<Spring>& springs,
+                      const SimulationParams& params) override;
+        void reset() override;          // forgets the last step's change in velocity
+        void step(std::vector<Particle>& particles, const std::vector<Spring>& springs,
+                  const SimulationParams& params) override;
+        std::string describe() const override;
+        std::string statistics() const override;
+
+        size_t getSolves() const { return solves; }
+        size_t getTotalIterations() const { return totalIterations; }
+        size_t getNewtonIterations() const { return newtonIterations; }
+        size_t getBacktracks() const { return backtracks; }
+
+    private:
+        const size_t MIN_CHUNK = 256;
+        const double ARMIJO = 1E-4;             // of the predicted decrease a step has to achieve
+
+        unsigned int maxIterations;
+        ThreadPool& pool;
+        double tolerance;
+        NewtonOptions newton;
+        BlockHessian hessian;
+        size_t steps = 0;
+        size_t solves = 0;
+        size_t totalIterations = 0;
+        size_t newtonIterations = 0;
+        size_t backtracks = 0;
+
+        // per row
+        std::vector<glm::dvec3> rhs, velocities, residual, direction, product, preconditioned;
+        std::vector<glm::dmat3> inverseDiagonals;
+        std::vector<glm::dvec3> start, inertial, iterate, trial, gradient, newtonStep;
+        std::vector<glm::dvec3> lastVelocityChange;     // the previous step's, to warm start from
+
+        // per spring, p1 - p2 at the start of the step and its direction, for dampening
+        std::vector<glm::dvec3> startDifferences, startDirections;
+
+        void gatherForces(const std::vector<Particle>& particles, const std::vector<Spring>& springs,
+                          const SimulationParams& params);
+        unsigned int conjugateGradient(std::vector<glm::dvec3>& x, const std::vector<glm::dvec3>& b);
+        double dot(const std::vector<glm::dvec3>& a, const std::vector<glm::dvec3>& b) const;
+
+        void stepNewton(std::vector<Particle>& particles, const std::vector<Spring>& springs,
+                        const SimulationParams& params);
+        glm::dvec3 position(const std::vector<Particle>& particles, const std::vector<glm::dvec3>& rows, size_t particle) const;
+        double potential(const std::vector<Particle>& particles, const std::vector<Spring>& springs,
+                         const SimulationParams& params, const std::vector<glm::dvec3>& rows) const;
+        void potentialGradient(const std::vector<Particle>& particles, const std::vector<Spring>& springs,
+                               const SimulationParams& params);
+};
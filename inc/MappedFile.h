@@ -0,0 +1,33 @@
+#pragma once
+/*
+*   A whole file mapped read only into memory, unmapped when destroyed.
+*/
+
+#include <cstddef>
+#include <string>
+
+class MappedFile
+{
+    public:
+        MappedFile() {}
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        /*
+            Returns false after printing why if the file can't be opened or
+            mapped, or is empty.
+            parameters:
+                sequential: Hint that the file will be read front to back once
+        */
+        bool open(const std::string& path, bool sequential = true);
+        void close();
+
+        const char* data() const { return (const char*)mapping; }
+        size_t size() const { return length; }
+
+    private:
+        void* mapping = nullptr;
+        size_t length = 0;
+};
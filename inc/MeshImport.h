@@ -0,0 +1,45 @@
+#pragma once
+/*
+*   Builds a spring network from a mesh file, either an OBJ surface or a
+*   tetgen .node/.ele volume. Every vertex becomes a particle. Springs are
+*
+*       structural  every face or tetrahedron edge
+*       shear       the diagonals of faces with more than three corners
+*       bending     between the far corners of two triangles sharing an
+*                   edge, or of two tetrahedra sharing a face
+*
+*   The file is mapped and parsed in chunks on the thread pool. Edges are
+*   deduplicated by sending each one to a shard picked by its hash, then
+*   every shard is deduplicated on its own thread, so no locks are taken.
+*/
+
+#include <glm/glm.hpp>
+#include <string>
+
+#include "SceneFile.h"
+#include "ThreadPool.h"
+
+struct ImportOptions
+{
+    float size = 5;                             // longest side of the bounding box after import
+    glm::vec3 centre = glm::vec3(0, 4, 0);      // of the bounding box after import
+    float particleMass = 0.001;
+    float structuralStiffness = 0.3;
+    float shearStiffness = 0.15;
+    float bendingStiffness = 0.03;
+    float dampingRatio = 1.0;                   // 1 is critically damped
+};
+
+namespace MeshImport
+{
+    bool canLoad(const std::string& path);      // by extension, .obj .node or .ele
+
+    /*
+        Fills scene with the particles, springs, surface triangles, a ground
+        collider and a camera looking at the mesh. Returns false after
+        printing why if the file can't be read.
+        parameters:
+            path:   An .obj file, or either file of a tetgen .node/.ele pair
+    */
+    bool load(const std::string& path, const ImportOptions& options, ThreadPool& threadPool, SceneData& scene);
+}
@@ -0,0 +1,84 @@
+#pragma once
+/*
+*   Geometric multigrid for a symmetric positive definite system whose
+*   unknowns sit on a regular grid. Each coarser level keeps every other
+*   node along each axis, and the last one when the axis has an even
+*   number, interpolating the rest (trilinearly, which is bilinear on a
+*   one deep cloth). Its matrix is the Galerkin product P^T A P, so
+*   nothing about the physics has to be rediscretized. A
+*   V-cycle smooths the error with a few weighted Jacobi sweeps, which
+*   only touch neighbours and run in parallel, moves what's left to the
+*   next level down, and solves the coarsest level exactly. The work per
+*   cycle is linear in the unknowns and the cycles it takes barely grows
+*   with resolution.
+*/
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Solver.h"
+#include "SparseCholesky.h"
+#include "ThreadPool.h"
+
+struct MultigridOptions
+{
+    unsigned int cycles = 1;                // V-cycles per solve
+    unsigned int smoothing = 2;             // Jacobi sweeps before and after each coarse correction
+    unsigned int maxLevels = 0;             // 0 keeps coarsening until coarsestSize
+    size_t coarsestSize = 512;              // unknowns small enough to factor
+    double jacobiWeight = 0.6;
+};
+
+class Multigrid
+{
+    public:
+        static constexpr size_t STATIC = SIZE_MAX;
+
+        /*
+            Builds the hierarchy for a matrix over some of a grid's nodes.
+            parameters:
+                rows:       Per grid node, its row in the matrix or STATIC if it isn't an unknown
+                entries:    The matrix's lower triangle
+            Returns false if the coarsest level can't be factored.
+        */
+        bool build(const ParticleGrid& grid, const std::vector<size_t>& rows, size_t size,
+                   const std::vector<SparseCholesky::Entry>& entries, const MultigridOptions& options, ThreadPool& pool);
+
+        // options.cycles V-cycles on A x = b, starting from x
+        void solve(std::vector<glm::dvec3>& x, const std::vector<glm::dvec3>& b);
+
+        size_t getLevelCount() const { return levels.size(); }
+        size_t getCoarsestSize() const { return levels.empty() ? 0 : levels.back().A.rows(); }
+
+    private:
+        struct Matrix
+        {
+            std::vector<size_t> rowStarts;
+            std::vector<size_t> columns;
+            std::vector<double> values;
+
+            size_t rows() const { return rowStarts.empty() ? 0 : rowStarts.size() - 1; }
+        };
+
+        struct Level
+        {
+            Matrix A;
+            std::vector<double> inverseDiagonal;
+            Matrix P;                       // to this level from the next coarser one
+            Matrix R;                       // P^T
+            std::vector<glm::dvec3> x, b, residual;
+        };
+
+        MultigridOptions options;
+        ThreadPool* pool = nullptr;
+        std::vector<Level> levels;
+        SparseCholesky coarsest;
+
+        static Matrix fromEntries(size_t size, const std::vector<SparseCholesky::Entry>& entries);
+        static Matrix transpose(const Matrix& matrix, size_t columns);
+        static Matrix multiply(const Matrix& a, const Matrix& b, size_t columns);
+
+        void multiply(const Matrix& matrix, const std::vector<glm::dvec3>& x, std::vector<glm::dvec3>& result) const;
+        void smooth(Level& level) const;
+        void cycle(size_t level);
+};
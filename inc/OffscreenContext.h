@@ -0,0 +1,32 @@
+#pragma once
+/*
+*   An OpenGL context with no window, for machines without a display.
+*   Uses EGL on Mesa's surfaceless platform (falling back to the default
+*   display), and renders into a framebuffer object of a fixed size that
+*   stays bound for the life of the context.
+*/
+
+#include <glad/glad.h>
+
+class OffscreenContext
+{
+    public:
+        OffscreenContext() {}
+        ~OffscreenContext();
+
+        OffscreenContext(const OffscreenContext&) = delete;
+        OffscreenContext& operator=(const OffscreenContext&) = delete;
+
+        /*
+            Creates a 4.1 core context, makes it current, loads the GL functions
+            and binds a width x height colour + depth framebuffer.
+            Returns false if any step fails, after printing why.
+        */
+        bool init(int width, int height);
+
+    private:
+        void* display = nullptr;        // EGLDisplay, kept opaque so users don't need the EGL headers
+        void* context = nullptr;        // EGLContext
+        GLuint framebuffer = 0;
+        GLuint renderbuffers[2] = {};   // colour, depth
+};
@@ -0,0 +1,122 @@
+#pragma once
+/*
+*   Projective dynamics: an implicit Euler step found by alternating a
+*   local step, which moves each spring's ends to its rest length, and a
+*   global step, which finds the positions that best fit all of those at
+*   once while keeping the momentum. The global step's matrix
+*
+*       M / deltaT^2 + sum over springs of stiffness (e1 - e2)(e1 - e2)^T
+*
+*   depends only on the masses, stiffnesses, topology and deltaT, never on
+*   the positions, so setScene factors it once and each iteration is a
+*   parallel local step and one back substitution. x, y and z share the
+*   matrix and are solved together. Static particles aren't unknowns,
+*   their springs pull on the others from fixed positions.
+*
+*   The factor's envelope grows with the scene, so for big ones the global
+*   step can instead be a single Jacobi sweep, which needs no factor and
+*   is parallel over every particle, optionally with Chebyshev
+*   acceleration. Chebyshev weights each iteration's result against the
+*   one two iterations back by how fast Jacobi converges, which is the
+*   spectral radius of its iteration matrix. The matrix is fixed, so
+*   setScene estimates that once by power iteration. On a grid scene the
+*   global step can also be V-cycles of geometric multigrid, whose
+*   hierarchy setScene builds once.
+*
+*   Iterations start from momentum plus however far the springs moved the
+*   particles from it last step, rather than momentum alone, which on
+*   smooth motion is already close. With a tolerance they stop once the
+*   global system's residual is below it, relative to the residual at
+*   momentum alone so that a better start doesn't make it any stricter.
+*/
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Multigrid.h"
+#include "Solver.h"
+#include "SparseCholesky.h"
+#include "ThreadPool.h"
+
+class ProjectiveSolver : public Solver
+{
+    public:
+        enum GlobalStep
+        {
+            Cholesky,           // solved exactly against the prefactored matrix
+            Jacobi,             // one sweep
+            Chebyshev,          // one sweep, accelerated
+            Multigrid           // V-cycles, falling back to Cholesky on scenes that aren't grids
+        };
+
+        /*
+            parameters:
+                iterations: Local and global steps per step
+                pool:       Runs the local and global steps, must outlive the solver
+                tolerance:  Relative residual to stop iterating at, 0 runs every iteration
+        */
+        ProjectiveSolver(unsigned int iterations, ThreadPool& pool, GlobalStep globalStep = Cholesky,
+                         const MultigridOptions& multigridOptions = MultigridOptions(), double tolerance = 0);
+
+        // "cholesky", "jacobi", "chebyshev" or "multigrid"
+        static bool parseGlobalStep(const std::string& name, GlobalStep& globalStep);
+
+        void setGrid(const ParticleGrid& grid) override { this->grid = grid; }
+        void setScene(const std::vector<Particle>& particles, const std::vector<Spring>& springs,
+                      const SimulationParams& params) override;
+        void reset() override;          // forgets the last step's correction
+        void step(std::vector<Particle>& particles, const std::vector<Spring>& springs,
+                  const SimulationParams& params) override;
+        std::string describe() const override;
+        std::string statistics() const override;
+
+    private:
+        const size_t MIN_CHUNK = 256;
+        const size_t STATIC = SIZE_MAX;         // the unknown of a static particle
+        const unsigned int POWER_ITERATIONS = 100;
+        const double RADIUS_SAFETY = 0.99;      // Chebyshev diverges if the radius is overestimated, not if under
+
+        struct Incidence
+        {
+            unsigned int spring;
+            float sign;                         // +1 at the spring's p1, -1 at its p2
+        };
+
+        unsigned int iterations;
+        ThreadPool& pool;
+        GlobalStep requestedStep;
+        GlobalStep globalStep;                  // the requested one unless the scene can't use it
+        MultigridOptions multigridOptions;
+        ParticleGrid grid;
+        double tolerance;
+        size_t steps = 0;
+        size_t iterationsRun = 0;
+
+        std::vector<size_t> unknowns;           // per particle, its row in the matrix or STATIC
+        std::vector<size_t> particleIndices;    // per row, its particle
+        std::vector<size_t> incidenceStarts;    // row r's springs are incidences[incidenceStarts[r], incidenceStarts[r + 1])
+        std::vector<Incidence> incidences;
+        SparseCholesky cholesky;
+        float factoredDeltaT = 0;
+        bool factored = false;
+        double factorSeconds = 0;
+        std::vector<double> diagonal;           // per row, for Jacobi
+        double spectralRadius = 0;              // of the Jacobi iteration matrix
+        ::Multigrid multigrid;
+
+        std::vector<glm::vec3> previous;        // positions at the start of the step
+        std::vector<glm::vec3> inertial;        // where momentum alone would take each particle
+        std::vector<glm::vec3> projections;     // per spring, p1 - p2 at rest length
+        std::vector<glm::dvec3> solution;       // per row, the right hand side and then the positions
+        std::vector<glm::vec3> older;           // per row, positions two iterations back, for Chebyshev
+        std::vector<glm::dvec3> guess;          // per row, where multigrid starts from
+        std::vector<glm::vec3> lastCorrection;  // per particle, the last step's move away from inertial, per deltaT
+        std::vector<double> residuals;          // per row, |b - A x|^2
+
+        bool factor(const std::vector<Particle>& particles, const std::vector<Spring>& springs, float deltaT);
+        void estimateSpectralRadius(const std::vector<Spring>& springs);
+        void gather(const std::vector<Particle>& particles, const std::vector<Spring>& springs, float deltaT, bool jacobi);
+        void project(const std::vector<Particle>& particles, const std::vector<Spring>& springs);
+        double residualNorm(const std::vector<Particle>& particles, const std::vector<Spring>& springs);
+};
@@ -0,0 +1,34 @@
+#pragma once
+/*
+*   Helpers for packing particle positions into 16 bit normalized integers
+*   relative to the bounding box of the positions. The vertex shader undoes
+*   the packing with positionOffset + aPos * positionScale.
+*/
+
+#include <glm/glm.hpp>
+#include <cstddef>
+
+struct Bounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+/*
+    parameters:
+        positions:  Tightly packed xyz positions
+        size:       Number of floats in positions (3 per position)
+*/
+Bounds computeBounds(const float positions[], size_t size);
+
+/*
+    Maps every component of positions from [bounds.min, bounds.max] onto [0, 65535]
+    and writes the result to out, which must hold size elements.
+*/
+void quantizePositions(const float positions[], size_t size, const Bounds& bounds, unsigned short out[]);
+
+/*
+    The scale that turns a normalized [0, 1] attribute back into a position
+    inside bounds. Add bounds.min afterwards.
+*/
+glm::vec3 dequantizeScale(const Bounds& bounds);
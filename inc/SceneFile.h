@@ -0,0 +1,99 @@
+#pragma once
+/*
+*   Binary scene files. A small header is followed by a table of sections,
+*   each one a packed array of the same structs the simulation uses, so
+*   loading maps the file and copies every array straight into place with
+*   no parsing. Unknown sections are skipped, so newer files still load in
+*   older builds as long as the version matches.
+*
+*   The copy is on purpose rather than spans over the mapping. The
+*   simulation owns its particles and writes them every step, pins rewrite
+*   particle masses as the file loads, and the springs and indices end up
+*   in vectors the solvers and GPU buffers already take, so every array
+*   would be copied anyway. It is one memcpy per section at memory speed,
+*   and the mapping closes as soon as load returns instead of having to
+*   live as long as the scene.
+*
+*   Files are written in the host's byte order, which is little endian on
+*   every machine this runs on.
+*/
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Spring.h"
+
+struct GroundCollider
+{
+    float height;           // y of the plane
+    float halfExtent;       // drawn as a square this far out from the origin
+};
+
+struct SceneCamera
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    float particleRadius;
+};
+
+struct SimulationState
+{
+    double time;            // seconds simulated
+};
+
+/*
+    Everything a scene builder produces. Stiffness and damping live on each
+    spring and mass on each particle, which is all the material data the
+    simulation has.
+*/
+struct SceneData
+{
+    std::vector<Particle> particles;
+    std::vector<Spring> springs;
+    std::vector<unsigned int> lineIndices;          // spring lines, coarsest level of detail first
+    std::vector<unsigned int> lodIndexCounts;       // line indices drawn at each level
+    std::vector<unsigned int> surfaceTriangles;     // particle indices, empty without a surface
+    std::vector<unsigned int> pins;                 // particles that never move
+    std::vector<GroundCollider> colliders;
+    SceneCamera camera;
+    double simulationTime = 0;                      // non zero for checkpoints of a running simulation
+};
+
+namespace SceneFile
+{
+    const char MAGIC[8] = { 'S', 'P', 'R', 'S', 'C', 'E', 'N', 'E' };
+    const uint32_t VERSION = 1;
+
+    enum SectionType : uint32_t
+    {
+        Particles = 1,
+        Springs,
+        LineIndices,
+        LodIndexCounts,
+        SurfaceTriangles,
+        Pins,
+        Colliders,
+        Camera,
+        Simulation
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t sectionCount;      // entries in the section table that follows
+    };
+
+    struct Section
+    {
+        uint32_t type;
+        uint32_t elementSize;       // sizeof the struct when written, checked on load
+        uint64_t offset;            // from the start of the file, 16 byte aligned
+        uint64_t count;
+    };
+
+    bool save(const std::string& path, const SceneData& scene);
+    bool load(const std::string& path, SceneData& scene);   // prints why and returns false on a bad file
+}
@@ -6,13 +6,14 @@
 */
 #include <glad/glad.h>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <glm/glm.hpp>
 
 class Shader 
 {
 	public: 
-		Shader() {}
+		Shader() : ID(0) {}
 		Shader(std::string vertexPath, std::string fragmentPath);
 		~Shader();
 		GLuint getID() const;
@@ -34,5 +35,7 @@ class Shader
 	private:
 		GLuint ID;
 		std::vector<GLuint> shaders;
+		std::unordered_map<std::string, GLint> uniformLocations;	// looked up once per name
 		std::string parseShader(std::string shaderPath);
+		GLint getUniformLocation(const char *uniform);
 };
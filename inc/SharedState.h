@@ -0,0 +1,113 @@
+#pragma once
+/*
+*   Live particle positions shared with other processes through POSIX
+*   shared memory (/dev/shm), so a simulation running headless can be
+*   watched by any number of viewers that come and go independently of it.
+*
+*       Header
+*       Slot...         Header::slotCount of them, SlotHeader then xyz per particle
+*
+*   The publisher writes snapshots round robin through the slots. Each slot
+*   has a sequence counter that is odd while the slot is being written, and
+*   a reader keeps its copy of a slot only if the counter was even and
+*   unchanged across the copy. Neither side ever waits for the other; a
+*   reader that was overtaken mid copy just tries the newest slot again.
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Spring.h"
+
+namespace SharedState
+{
+    const char MAGIC[8] = { 'S', 'P', 'R', 'S', 'H', 'M', '0', '1' };
+    const uint32_t SLOTS = 4;
+
+    // other processes see these through the mapping, so they can't fall back to a lock
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory needs lock free 64 bit atomics");
+
+    struct Header
+    {
+        char magic[8];                          // written last, readers ignore the header until it's there
+        uint32_t particleCount;
+        uint32_t slotCount;
+        uint64_t slotsOffset;                   // from the start of the mapping
+        uint64_t slotSize;                      // bytes from one SlotHeader to the next
+        std::atomic<uint64_t> published;        // snapshots written so far, the newest is in slot (published - 1) % slotCount
+        std::atomic<uint32_t> closed;           // set when the publisher exits
+    };
+
+    struct SlotHeader
+    {
+        std::atomic<uint64_t> sequence;         // odd while the slot is being written
+        uint64_t snapshot;                      // which snapshot the slot holds
+        double time;
+    };
+
+    // shm_open wants a leading slash
+    std::string objectName(const std::string& name);
+}
+
+class SharedStatePublisher
+{
+    public:
+        SharedStatePublisher() {}
+        ~SharedStatePublisher();            // calls close
+
+        SharedStatePublisher(const SharedStatePublisher&) = delete;
+        SharedStatePublisher& operator=(const SharedStatePublisher&) = delete;
+
+        /*
+            Creates the shared memory object, replacing any left by a publisher
+            that didn't exit cleanly. Prints why and returns false on failure.
+        */
+        bool open(const std::string& name, size_t particleCount);
+        void publish(const std::vector<Particle>& particles, double time);
+        void close();                       // tells readers, then removes the name. Their mappings stay valid
+
+        bool isOpen() const { return header != nullptr; }
+
+    private:
+        std::string name;
+        void* mapping = nullptr;
+        size_t length = 0;
+        SharedState::Header* header = nullptr;
+};
+
+class SharedStateReader
+{
+    public:
+        SharedStateReader() {}
+        ~SharedStateReader();              // calls detach
+
+        SharedStateReader(const SharedStateReader&) = delete;
+        SharedStateReader& operator=(const SharedStateReader&) = delete;
+
+        /*
+            Maps a publisher's object read only. Returns false quietly if there is
+            no publisher yet, or after printing why if the object is unusable.
+        */
+        bool attach(const std::string& name);
+        void detach();
+
+        bool isAttached() const { return header != nullptr; }
+        bool isClosed() const;             // the publisher has exited
+        size_t getParticleCount() const { return header ? header->particleCount : 0; }
+
+        /*
+            Copies the newest snapshot, xyz per particle. Returns false if there is
+            nothing newer than the last one read, or the publisher kept
+            overwriting the slot while it was being copied.
+        */
+        bool read(float positions[], double& time);
+
+    private:
+        void* mapping = nullptr;
+        size_t length = 0;
+        const SharedState::Header* header = nullptr;
+        uint64_t lastPublished = 0;
+};
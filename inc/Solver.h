@@ -0,0 +1,133 @@
+#pragma once
+/*
+*   Advances particles connected by springs by one timestep. Engine keeps a
+*   solver for the scene it draws, and runs that draw nothing, such as
+*   parameter sweeps, make their own.
+*/
+
+#include <cmath>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "Spring.h"
+
+struct SimulationParams
+{
+    float deltaT = 0.0001;                          // in seconds
+    glm::vec3 gravity = glm::vec3(0, -9.81f, 0);
+    float airDampening = 0.0001;
+    bool ground = false;                            // particles bounce off a floor at groundHeight
+    float groundHeight = 0;
+};
+
+// Particles laid out on a regular grid, the one at node (x, y, z) being (x * size.y + y) * size.z + z
+struct ParticleGrid
+{
+    glm::uvec3 size = glm::uvec3(0);        // all 0 when the scene isn't a grid
+
+    size_t nodes() const { return (size_t)size.x * size.y * size.z; }
+};
+
+class Solver
+{
+    public:
+        virtual ~Solver() {}
+
+        // Called before setScene with how the scene's particles are laid out
+        virtual void setGrid(const ParticleGrid& grid) {}
+
+        // Called with each newly built scene, for solvers that precompute from its topology
+        virtual void setScene(const std::vector<Particle>& particles, const std::vector<Spring>& springs,
+                              const SimulationParams& params) {}
+
+        // Called when the particles are put back where the scene started, for solvers that carry state between steps
+        virtual void reset() {}
+
+        // A line on how it's set up for the scene, printed when the scene is built. Empty prints nothing
+        virtual std::string describe() const { return std::string(); }
+
+        // A line on how the run went, printed at exit. Empty prints nothing
+        virtual std::string statistics() const { return std::string(); }
+
+        // Advances particles by params.deltaT
+        virtual void step(std::vector<Particle>& particles, const std::vector<Spring>& springs,
+                          const SimulationParams& params) = 0;
+};
+
+/*
+    Symplectic Euler on the spring, gravity and drag forces, the integrator
+    the program has always used. Only stable for small timesteps.
+*/
+class ExplicitSolver : public Solver
+{
+    public:
+        void step(std::vector<Particle>& particles, const std::vector<Spring>& springs,
+                  const SimulationParams& params) override;
+
+        static glm::vec3 springForce(const Spring& spring, const std::vector<Particle>& particles);
+
+        /*
+            The largest deltaT step stays stable at, from a Gershgorin bound on
+            the highest spring frequency and the air dampening, and with a
+            ground from how deep a falling particle lands in it. The spring
+            bound is an overestimate, so this errs small. Spring dampening is
+            left out, it vanishes at rest length. INFINITY if nothing limits it.
+        */
+        static float stableTimestep(const std::vector<Particle>& particles, const std::vector<Spring>& springs,
+                                    const SimulationParams& params);
+
+    private:
+        static constexpr float EPSILON = 1E-5;
+        static constexpr float CONTACT_DEPTH = 0.01;    // of the shortest spring, most a step may land below the ground
+};
+
+/*
+    ExplicitSolver with a step size of its own that grows while little is
+    happening and shrinks through impacts. Each deltaT is covered by as many
+    substeps as it takes. Every substep is taken once at full size and again
+    as two halves; the two differ by about the error of the full step, and a
+    substep is accepted, keeping the halves, only when that is within the
+    tolerance. Either way the next size is picked from how close it was.
+*/
+class AdaptiveSolver : public Solver
+{
+    public:
+        /*
+            parameters:
+                tolerance:  Most a particle may be off after one substep, in
+                            scene units. Velocity errors count times the step.
+        */
+        explicit AdaptiveSolver(float tolerance);
+
+        void reset() override;          // back to the first step size, the run's counts are kept
+        void step(std::vector<Particle>& particles, const std::vector<Spring>& springs,
+                  const SimulationParams& params) override;
+
+        float getTolerance() const { return tolerance; }
+        size_t getAccepted() const { return accepted; }
+        size_t getRejected() const { return rejected; }
+        float getSmallestStep() const { return smallestStep; }
+        float getLargestStep() const { return largestStep; }
+
+    private:
+        const float MIN_STEP = 1E-7;        // accepted regardless, so a discontinuity can't stall it
+        const float SAFETY = 0.9;
+        const float MAX_SHRINK = 0.2;
+        const float MAX_GROWTH = 2;
+        const float FIRST_STEP = 1E-4;
+
+        ExplicitSolver explicitSolver;
+        float tolerance;
+        float stepSize = FIRST_STEP;        // the next one to try
+        size_t accepted = 0;
+        size_t rejected = 0;
+        float smallestStep = INFINITY;
+        float largestStep = 0;
+
+        // reused between substeps so stepping never allocates
+        std::vector<Particle> full;
+        std::vector<Particle> halves;
+
+        float error(const std::vector<Particle>& a, const std::vector<Particle>& b, float step) const;
+};
@@ -0,0 +1,56 @@
+#pragma once
+/*
+*   A fixed size single producer, single consumer queue with no locks.
+*   Slots are allocated up front and reused, so the producer fills a slot
+*   in place between beginPush and endPush, and the consumer reads it in
+*   place between front and pop.
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+template <typename T>
+class SpscQueue
+{
+    public:
+        explicit SpscQueue(size_t capacity) : slots(capacity + 1) {}     // one slot always stays empty
+
+        SpscQueue(const SpscQueue&) = delete;
+        SpscQueue& operator=(const SpscQueue&) = delete;
+
+        // producer side, beginPush returns null when the queue is full
+        T* beginPush()
+        {
+            size_t current = tail.load(std::memory_order_relaxed);
+            if (next(current) == head.load(std::memory_order_acquire))
+                return nullptr;
+            return &slots[current];
+        }
+        void endPush()
+        {
+            tail.store(next(tail.load(std::memory_order_relaxed)), std::memory_order_release);
+        }
+
+        // consumer side, front returns null when the queue is empty
+        T* front()
+        {
+            size_t current = head.load(std::memory_order_relaxed);
+            if (current == tail.load(std::memory_order_acquire))
+                return nullptr;
+            return &slots[current];
+        }
+        void pop()
+        {
+            head.store(next(head.load(std::memory_order_relaxed)), std::memory_order_release);
+        }
+
+        std::vector<T>& getSlots() { return slots; }       // for preallocating, before either side runs
+
+    private:
+        std::vector<T> slots;
+        alignas(64) std::atomic<size_t> head{0};        // next slot to read, written by the consumer
+        alignas(64) std::atomic<size_t> tail{0};        // next slot to write, written by the producer
+
+        size_t next(size_t index) const { return index + 1 == slots.size() ? 0 : index + 1; }
+};
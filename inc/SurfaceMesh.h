@@ -0,0 +1,50 @@
+#pragma once
+/*
+*   The outer triangles of a deformable object. Built once when a scene is
+*   created, then every frame the vertex normals are recomputed from the
+*   current particle positions for lit rendering.
+*/
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Spring.h"
+#include "ThreadPool.h"
+
+class SurfaceMesh
+{
+    public:
+        SurfaceMesh() {}
+
+        /*
+            parameters:
+                triangles:  Particle indices, 3 per triangle, wound counter clockwise
+                            when seen from outside the object
+        */
+        explicit SurfaceMesh(const std::vector<unsigned int>& triangles);
+
+        bool empty() const { return triangles.empty(); }
+
+        /*
+            Refreshes the interleaved position/normal vertex data from particles.
+            Face normals and vertex normals are each computed in a parallel pass
+            with no shared writes.
+        */
+        void update(const std::vector<Particle>& particles, ThreadPool& threadPool);
+
+        const std::vector<unsigned int>& getTriangles() const { return triangles; }
+        std::vector<unsigned int> getParticleTriangles() const;        // as passed to the constructor
+        const std::vector<float>& getVertices() const { return vertices; }   // x y z nx ny nz per vertex
+        size_t getVertexCount() const { return particleIndices.size(); }
+
+    private:
+        std::vector<unsigned int> triangles;            // indices into the surface vertices
+        std::vector<unsigned int> particleIndices;      // surface vertex -> particle
+
+        // triangles touching each surface vertex, stored as offsets into vertexTriangles
+        std::vector<unsigned int> vertexTriangleOffsets;
+        std::vector<unsigned int> vertexTriangles;
+
+        std::vector<glm::vec3> faceNormals;             // area weighted
+        std::vector<float> vertices;
+};
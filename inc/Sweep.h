@@ -0,0 +1,103 @@
+#pragma once
+/*
+*   Parameter sweeps: every combination of a few ranges of simulation
+*   parameters, each run headless with its own ExplicitSolver on a
+*   WorkStealingPool. Runs differ a lot in cost (a smaller timestep or a
+*   bigger grid means more work, an unstable run stops early), which is why
+*   they're stolen rather than split evenly up front.
+*
+*   A sweep file has one parameter per line, "name first last count",
+*   spaced evenly from first to last, or "name value" for a single value:
+*
+*       stiffness       0.1     2       8
+*       dampening       0.01    0.1     4
+*       deltaT          1e-4    1e-3    4
+*       airDampening    0       0.001   2
+*       gridSize        4       8       3
+*       seconds         5
+*
+*   Parameters that aren't listed keep the scene's values.
+*/
+
+#include <cmath>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Solver.h"
+#include "Spring.h"
+#include "WorkStealingPool.h"
+
+struct SweepRange
+{
+    float first = 0;
+    float last = 0;
+    unsigned int count = 0;         // 0 when the parameter isn't swept
+
+    float at(unsigned int i) const { return count > 1 ? first + (last - first) * i / (count - 1) : first; }
+};
+
+struct SweepSpec
+{
+    SweepRange stiffness;
+    SweepRange dampening;
+    SweepRange deltaT;
+    SweepRange airDampening;
+    SweepRange gridSize;
+    double seconds = 5;             // simulated per run
+};
+
+struct SweepRun
+{
+    unsigned int gridSize;
+    float stiffness;                // NAN keeps each spring's own
+    float dampening;                // NAN keeps each spring's own
+    float deltaT;
+    float airDampening;
+};
+
+struct SweepResult
+{
+    bool stable;                    // stayed finite and the energy never grew by more than 1%
+    double energyDrift;             // change in total energy over the run, relative to the start
+    size_t steps;                   // fewer than planned if the run blew up
+    double wallSeconds;
+    unsigned int thread;
+};
+
+// What a run starts from, one per grid size
+struct SweepScene
+{
+    std::vector<Particle> particles;
+    std::vector<Spring> springs;
+    SimulationParams params;
+};
+
+namespace Sweep
+{
+    // Prints why and returns false on a malformed file
+    bool loadSpec(const std::string& path, SweepSpec& spec);
+
+    /*
+        Every combination of the swept parameters, grid size varying slowest.
+        parameters:
+            gridSize, deltaT, airDampening: Used for the parameters that aren't swept
+    */
+    std::vector<SweepRun> expand(const SweepSpec& spec, unsigned int gridSize, float deltaT, float airDampening);
+
+    /*
+        Runs every run on pool for seconds of simulated time.
+        parameters:
+            scenes: The starting scene for each grid size in runs
+    */
+    std::vector<SweepResult> run(const std::vector<SweepRun>& runs, const std::map<unsigned int, SweepScene>& scenes,
+                                 double seconds, WorkStealingPool& pool);
+
+    // CSV, one row per run
+    void writeResults(std::ostream& out, const std::vector<SweepRun>& runs, const std::vector<SweepResult>& results);
+
+    // Kinetic, spring and gravitational, with the lowest particle at the start as zero height
+    double energy(const std::vector<Particle>& particles, const std::vector<Spring>& springs, glm::vec3 gravity,
+                  float baseHeight);
+}
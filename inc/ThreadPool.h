@@ -0,0 +1,52 @@
+#pragma once
+/*
+*   A fixed set of worker threads that run submitted tasks. parallelFor
+*   splits an index range into chunks and blocks until every chunk ran,
+*   with the calling thread helping out.
+*/
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+    public:
+        /*
+            parameters:
+                threadCount:    Number of worker threads. 0 uses one per hardware thread,
+                                minus one for the thread that calls parallelFor
+        */
+        explicit ThreadPool(unsigned int threadCount = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        void submit(std::function<void()> task);
+        void wait();        // blocks until every submitted task has finished
+
+        /*
+            Calls body(chunkBegin, chunkEnd) over [begin, end) in chunks of at least
+            minChunk indices. Chunks may run in any order and on any thread, so body
+            must only write to data owned by its own indices.
+        */
+        void parallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)>& body, size_t minChunk = 1024);
+
+        unsigned int size() const { return workers.size(); }
+
+    private:
+        std::vector<std::thread> workers;
+        std::deque< std::function<void()> > tasks;
+        std::mutex mutex;
+        std::condition_variable taskAvailable;
+        std::condition_variable tasksFinished;
+        unsigned int busyWorkers = 0;
+        bool stopping = false;
+
+        void workerLoop();
+};
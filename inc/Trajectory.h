@@ -0,0 +1,91 @@
+#pragma once
+/*
+*   The trajectory file format shared by the recorder and the player.
+*
+*       Header
+*       Block...        BlockHeader then the block's stored bytes
+*       BlockIndex...   one per block
+*       Footer          where the index starts
+*
+*   Positions are quantized to multiples of Header::step. Each block starts
+*   with a keyframe of absolute values and every later frame in it stores
+*   the change from the frame before, as zigzag varints, so particles that
+*   barely move cost a byte per axis. A block is then compressed as a whole
+*   with zstd when the build has it, or with a zero run packer otherwise.
+*   Any frame can be decoded from the start of its block alone.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Trajectory
+{
+    const char MAGIC[8] = { 'S', 'P', 'R', 'T', 'R', 'A', 'J', '1' };
+    const char FOOTER_MAGIC[8] = { 'S', 'P', 'R', 'T', 'I', 'D', 'X', '1' };
+
+    enum Compression : uint32_t
+    {
+        Uncompressed,
+        ZeroRuns,           // built in, a zero byte is followed by the run length
+        Zstd
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t particleCount;
+        uint32_t framesPerBlock;        // keyframe interval
+        float step;                     // quantization step, in scene units
+        float frameInterval;            // simulated seconds between frames
+        uint32_t compression;
+        uint32_t reserved = 0;
+    };
+
+    struct BlockHeader
+    {
+        uint32_t firstFrame;
+        uint32_t frameCount;
+        uint32_t rawSize;               // after decompression
+        uint32_t storedSize;            // bytes that follow
+    };
+
+    struct BlockIndex
+    {
+        uint64_t offset;                // of the BlockHeader from the start of the file
+        uint32_t firstFrame;
+        uint32_t frameCount;
+    };
+
+    struct Footer
+    {
+        uint64_t indexOffset;
+        uint32_t blockCount;
+        uint32_t frameCount;
+        char magic[8];
+    };
+
+    // Compression the build supports best
+    Compression defaultCompression();
+
+    /*
+        Appends one frame to a block. previous holds the quantized positions of
+        the frame before and is updated, keyframe ignores it.
+        parameters:
+            positions:  xyz per particle
+    */
+    void encodeFrame(const float positions[], size_t count, double time, float step, bool keyframe,
+                     std::vector<int32_t>& previous, std::vector<unsigned char>& block);
+
+    /*
+        Reads the frame starting at offset in a decompressed block and returns
+        the offset of the next one, or 0 if the block is too short.
+    */
+    size_t decodeFrame(const std::vector<unsigned char>& block, size_t offset, size_t count, float step, bool keyframe,
+                       std::vector<int32_t>& previous, float positions[], double& time);
+
+    bool compress(Compression compression, const std::vector<unsigned char>& raw, std::vector<unsigned char>& stored);
+    bool decompress(Compression compression, const unsigned char stored[], size_t storedSize, size_t rawSize,
+                    std::vector<unsigned char>& raw);
+}
@@ -0,0 +1,75 @@
+#pragma once
+/*
+*   Reads frames back out of a trajectory file (see Trajectory.h) for
+*   playback. The file is mapped and frames are found through its block
+*   index. Whole blocks are decoded at once and cached, and a prefetch
+*   thread decodes the next blocks in the direction of playback before
+*   they are needed, so stepping forwards, backwards or scrubbing within a
+*   block never decodes on the calling thread.
+*/
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Trajectory.h"
+
+class TrajectoryPlayer
+{
+    public:
+        TrajectoryPlayer() {}
+        ~TrajectoryPlayer();
+
+        TrajectoryPlayer(const TrajectoryPlayer&) = delete;
+        TrajectoryPlayer& operator=(const TrajectoryPlayer&) = delete;
+
+        bool open(const std::string& path);     // prints why and returns false on a bad file
+
+        size_t getFrameCount() const { return frameCount; }
+        size_t getParticleCount() const { return header.particleCount; }
+        float getFrameInterval() const { return header.frameInterval; }
+        unsigned int getMisses() const { return misses; }      // frames that had to be decoded on the calling thread
+
+        /*
+            Copies a frame's positions, xyz per particle.
+            parameters:
+                direction:  1 when playing forwards and -1 backwards, picks the blocks to prefetch
+        */
+        bool getFrame(size_t frame, int direction, float positions[], double& time);
+
+    private:
+        struct DecodedBlock
+        {
+            size_t block;
+            std::vector<float> positions;       // every frame in the block
+            std::vector<double> times;
+        };
+
+        MappedFile file;
+        Trajectory::Header header;
+        std::vector<Trajectory::BlockIndex> index;
+        size_t frameCount = 0;
+        unsigned int misses = 0;
+
+        std::mutex cacheMutex;
+        std::condition_variable wake;
+        std::thread prefetcher;
+        bool stopping = false;
+        std::vector< std::shared_ptr<const DecodedBlock> > cache;
+        size_t cacheCapacity = 4;
+        size_t wantedBlock = 0;
+        int wantedDirection = 1;
+
+        bool readIndex();
+        bool rebuildIndex();
+        bool readBlockHeader(size_t offset, Trajectory::BlockHeader& blockHeader) const;
+        size_t findBlock(size_t frame) const;
+        std::shared_ptr<const DecodedBlock> decode(size_t block) const;
+        std::shared_ptr<const DecodedBlock> cached(size_t block) const;     // with cacheMutex held
+        void insert(std::shared_ptr<const DecodedBlock> decoded);           // with cacheMutex held
+        void prefetchLoop();
+};
@@ -0,0 +1,68 @@
+#pragma once
+/*
+*   Records particle positions to a trajectory file (see Trajectory.h)
+*   without slowing the simulation down. record() only copies positions into
+*   a preallocated slot of a lock free queue; a writer thread quantizes,
+*   encodes, compresses and writes them. If the writer falls behind the
+*   frame is dropped rather than waited for, and the drops are reported.
+*/
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Spring.h"
+#include "SpscQueue.h"
+#include "Trajectory.h"
+
+class TrajectoryRecorder
+{
+    public:
+        /*
+            parameters:
+                frameInterval:  Simulated seconds between recorded frames, stored for playback
+                step:           Quantization step in scene units
+        */
+        TrajectoryRecorder(size_t particleCount, float frameInterval, float step = 1e-4f, unsigned int framesPerBlock = 64);
+        ~TrajectoryRecorder();      // calls finish
+
+        TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+        TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+        bool open(const std::string& path);
+        void record(const std::vector<Particle>& particles, double time);
+        void finish();              // writes what is queued and the frame index, then closes the file
+
+        unsigned int getFramesWritten() const { return framesWritten; }
+        unsigned int getFramesDropped() const { return framesDropped; }
+
+    private:
+        struct Frame
+        {
+            std::vector<float> positions;
+            double time;
+        };
+
+        Trajectory::Header header;
+        FILE* file = nullptr;
+        SpscQueue<Frame> queue;
+        std::thread writer;
+        std::atomic<bool> stopping{false};
+        unsigned int framesDropped = 0;         // only touched by the recording thread
+
+        // only touched by the writer thread
+        std::vector<unsigned char> block;
+        std::vector<unsigned char> stored;
+        std::vector<int32_t> previous;
+        std::vector<Trajectory::BlockIndex> index;
+        unsigned int blockFrames = 0;
+        unsigned int framesWritten = 0;
+        bool failed = false;
+
+        void writerLoop();
+        void writeFrame(const Frame& frame);
+        void flushBlock();
+        void writeIndex();
+};
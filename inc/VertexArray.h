@@ -4,6 +4,7 @@
 */
 
 #include <glad/glad.h>
+#include <vector>
 
 
 class VertexArray
@@ -23,17 +24,35 @@ class VertexArray
         VertexArray() {};
         VertexArray(
             const int componentsPerAttribute[], size_t vertCompSize, const float buffer[], size_t buffSize, GLenum drawType = GL_STATIC_DRAW);
+
+        /*
+            Creates a second vertex array over the vertex buffer of source. Every attribute
+            advances once per divisor instances instead of once per vertex, so the same
+            positions can feed an instanced draw. source must outlive this vertex array.
+        */
+        VertexArray(const VertexArray& source, GLuint divisor);
         ~VertexArray();
         GLuint getID() const { return id; };
 
         void use() const;
         void unuse() const;
         void updateBuffer(const float buffer[], size_t buffSize);
+        void updateBuffer(const unsigned short buffer[], size_t buffSize);
         void setElementBuffer (const unsigned int buffer[], size_t buffSize);
+
+        /*
+            Re-points every attribute at the vertex buffer using a different component type,
+            eg. GL_UNSIGNED_SHORT with normalized = GL_TRUE for quantized data. The buffer
+            keeps its original size so it can hold either layout.
+        */
+        void setAttributeType(GLenum type, GLboolean normalized);
     private:
         GLuint id;
         GLuint vbo;
         GLuint ebo;
         GLenum drawType;
+        bool ownsBuffers = true;
+        std::vector<int> componentsPerAttribute;
+        void setAttributePointers(GLenum type, GLboolean normalized, size_t typeSize);
         int sumArray(int start, int end, const int array[]) const;
 };
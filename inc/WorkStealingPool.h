@@ -0,0 +1,53 @@
+#pragma once
+/*
+*   Runs a batch of independent tasks whose costs differ a lot and aren't
+*   known up front. Each thread starts with its own contiguous share of the
+*   tasks and works through it from the front; a thread that runs out takes
+*   tasks from the back of the fullest other share, so nobody sits idle
+*   while another thread still has a long queue. Each share has its own
+*   lock, which is only ever contended by a thief.
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class WorkStealingPool
+{
+    public:
+        /*
+            parameters:
+                threadCount:    0 uses one per hardware thread
+        */
+        explicit WorkStealingPool(unsigned int threadCount = 0);
+
+        WorkStealingPool(const WorkStealingPool&) = delete;
+        WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+        /*
+            Calls task(index, thread) for every index in [0, count) and returns
+            once all of them have finished. The calling thread is thread 0.
+        */
+        void run(size_t count, const std::function<void(size_t, unsigned int)>& task);
+
+        unsigned int size() const { return threadCount; }
+        size_t getSteals() const { return steals; }      // in the last run
+
+    private:
+        struct Share
+        {
+            std::mutex lock;
+            std::deque<size_t> tasks;
+        };
+
+        unsigned int threadCount;
+        std::vector<Share> shares;
+        std::atomic<size_t> steals{0};
+
+        bool takeOwn(unsigned int thread, size_t& task);
+        bool steal(unsigned int thread, size_t& task);
+        void work(unsigned int thread, const std::function<void(size_t, unsigned int)>& task);
+};
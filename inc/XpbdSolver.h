@@ -0,0 +1,67 @@
+#pragma once
+/*
+*   Extended position based dynamics: every spring is a distance constraint
+*   with compliance 1 / stiffness, solved by projecting positions rather
+*   than integrating forces, which keeps it stable at a whole frame per
+*   step. Springs that share no particle can be projected at the same time,
+*   so setScene colors the springs that way and each color is a parallelFor.
+*   Within a color the order doesn't matter, which makes results the same
+*   on any number of threads.
+*
+*   Each spring's multiplier is kept from one step to the next, and a step
+*   starts by applying part of them again, towards where the last step's
+*   projections ended up. Applying all of them pushes harder than the
+*   unconverged iterations pulled back and can gain energy step after
+*   step. With a tolerance the iterations then stop once every spring's
+*   residual, relative to its rest length, is below it.
+*/
+
+#include <vector>
+
+#include "Solver.h"
+#include "ThreadPool.h"
+
+class XpbdSolver : public Solver
+{
+    public:
+        /*
+            parameters:
+                iterations: Passes over every constraint per step
+                pool:       Runs the springs of a color, must outlive the solver
+                tolerance:  Relative residual to stop iterating at, 0 runs every iteration
+        */
+        XpbdSolver(unsigned int iterations, ThreadPool& pool, float tolerance = 0);
+
+        void setScene(const std::vector<Particle>& particles, const std::vector<Spring>& springs,
+                      const SimulationParams& params) override;
+        void reset() override;          // forgets the multipliers it would warm start from
+        void step(std::vector<Particle>& particles, const std::vector<Spring>& springs,
+                  const SimulationParams& params) override;
+
+        std::string describe() const override;
+        std::string statistics() const override;
+
+        unsigned int getIterations() const { return iterations; }
+        size_t getColorCount() const { return colorStarts.empty() ? 0 : colorStarts.size() - 1; }
+
+    private:
+        const size_t MIN_CHUNK = 256;       // springs per task, fewer cost more to hand out than to project
+        const float WARM_START = 0.5;       // of the last step's multipliers a step starts from
+
+        unsigned int iterations;
+        ThreadPool& pool;
+        float tolerance;
+        size_t steps = 0;
+        size_t iterationsRun = 0;
+
+        std::vector<unsigned int> order;            // spring indices grouped by color
+        std::vector<size_t> colorStarts;            // color c is order[colorStarts[c], colorStarts[c + 1])
+        std::vector<float> lambdas;                 // per spring, accumulated over a step's iterations and kept for the next
+        float lambdaDeltaT = 0;                     // the step lambdas were accumulated over
+        std::vector<float> chunkResiduals;          // largest of an iteration's, per MIN_CHUNK springs of order
+        std::vector<glm::vec3> previous;            // positions at the start of the step
+
+        void color(const std::vector<Particle>& particles, const std::vector<Spring>& springs);
+        void warmStart(std::vector<Particle>& particles, const std::vector<Spring>& springs, float deltaT);
+        float project(std::vector<Particle>& particles, const Spring& spring, float& lambda, float deltaT) const;
+};
@@ -0,0 +1,24 @@
+#version 410 core
+out vec4 fragColor;
+in vec3 viewCenter;
+in vec2 corner;
+uniform mat4 projection;
+uniform float radius;
+uniform vec4 uColor;
+
+const vec3 lightDirection = normalize(vec3(0.4, 0.8, 0.6));		// in view space
+
+void main()
+{
+	float distSquared = dot(corner, corner);
+	if (distSquared > 1.0)
+		discard;
+
+	// reconstruct the point on the sphere this fragment sees
+	vec3 normal = vec3(corner, sqrt(1.0 - distSquared));
+	vec4 clip = projection * vec4(viewCenter + normal * radius, 1.0);
+	gl_FragDepth = (clip.z / clip.w) * 0.5 + 0.5;
+
+	float diffuse = max(dot(normal, lightDirection), 0.0);
+	fragColor = vec4(uColor.rgb * (0.25 + 0.75 * diffuse), uColor.a);
+}
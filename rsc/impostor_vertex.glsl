@@ -0,0 +1,22 @@
+#version 410 core
+layout (location = 0) in vec3 aPos;		// particle centre, advances once per instance
+out vec3 viewCenter;
+out vec2 corner;
+uniform mat4 view;
+uniform mat4 projection;
+uniform float radius;
+uniform vec3 positionOffset = vec3(0.0);	// undoes 16 bit quantization, identity for float positions
+uniform vec3 positionScale = vec3(1.0);
+
+// drawn as a 4 vertex triangle strip per particle
+const vec2 corners[4] = vec2[4](vec2(-1, -1), vec2(1, -1), vec2(-1, 1), vec2(1, 1));
+
+void main()
+{
+	vec3 position = positionOffset + aPos * positionScale;
+	viewCenter = (view * vec4(position, 1.0)).xyz;
+	corner = corners[gl_VertexID];
+
+	// billboard facing the camera, large enough to cover the sphere
+	gl_Position = projection * vec4(viewCenter + vec3(corner * radius, 0.0), 1.0);
+}
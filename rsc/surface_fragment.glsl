@@ -0,0 +1,14 @@
+#version 410 core
+out vec4 fragColor;
+in vec3 normal;
+uniform vec4 uColor;
+
+const vec3 lightDirection = normalize(vec3(0.3, 1.0, 0.5));		// in world space
+
+void main()
+{
+	// the curtain is seen from both sides
+	vec3 n = normalize(gl_FrontFacing ? normal : -normal);
+	float diffuse = max(dot(n, lightDirection), 0.0);
+	fragColor = vec4(uColor.rgb * (0.2 + 0.8 * diffuse), uColor.a);
+}
@@ -3,11 +3,14 @@ layout (location = 0) in vec3 aPos;
 // layout (location = 1) in vec3 aColor;
 out vec4 vertexColor;
 uniform mat4 projectionView;
+uniform vec3 positionOffset = vec3(0.0);	// undoes 16 bit quantization, identity for float positions
+uniform vec3 positionScale = vec3(1.0);
 
 
 void main()
 {
 	// gl_Position = projection * view * model * vec4(aPos, 1.0);
-	gl_Position = projectionView * vec4(aPos, 1.0);
-	vertexColor = vec4(aPos, 1.0);
+	vec3 position = positionOffset + aPos * positionScale;
+	gl_Position = projectionView * vec4(position, 1.0);
+	vertexColor = vec4(position, 1.0);
 }
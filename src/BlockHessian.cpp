@@ -0,0 +1,141 @@
+#include "BlockHessian.h"
+#include <algorithm>
+
+using namespace std;
+
+BlockHessian::BlockHessian(ThreadPool& pool)
+: pool(pool)
+{
+}
+
+void BlockHessian::setScene(const vector<Particle>& particles, const vector<Spring>& springs)
+{
+    unknowns.assign(particles.size(), STATIC);
+    particleIndices.clear();
+    for (size_t i = 0; i < particles.size(); i++)
+    {
+        if (particles[i].mass > 0)
+        {
+            unknowns[i] = particleIndices.size();
+            particleIndices.push_back(i);
+        }
+    }
+
+    const size_t count = particleIndices.size();
+    incidenceStarts.assign(count + 1, 0);
+    for (const auto& spring : springs)
+    {
+        for (size_t end : { spring.p1, spring.p2 })
+        {
+            if (unknowns[end] != STATIC)
+                incidenceStarts[unknowns[end] + 1]++;
+        }
+    }
+    for (size_t r = 0; r < count; r++)
+        incidenceStarts[r + 1] += incidenceStarts[r];
+    incidences.resize(incidenceStarts[count]);
+    vector<size_t> others(incidences.size());          // each incidence's other end, while building
+    vector<size_t> next(incidenceStarts.begin(), incidenceStarts.end() - 1);
+    for (size_t s = 0; s < springs.size(); s++)
+    {
+        const size_t a = unknowns[springs[s].p1];
+        const size_t b = unknowns[springs[s].p2];
+        if (a != STATIC)
+        {
+            others[next[a]] = b;
+            incidences[next[a]++].spring = s;
+        }
+        if (b != STATIC)
+        {
+            others[next[b]] = a;
+            incidences[next[b]++].spring = s;
+        }
+    }
+
+    // each row's columns are itself and its moving neighbours, sorted, once each
+    rowStarts.assign(count + 1, 0);
+    columns.clear();
+    diagonalSlots.resize(count);
+    vector<size_t> rowColumns;
+    for (size_t r = 0; r < count; r++)
+    {
+        rowColumns.assign(1, r);
+        for (size_t i = incidenceStarts[r]; i < incidenceStarts[r + 1]; i++)
+        {
+            if (others[i] != STATIC)
+                rowColumns.push_back(others[i]);
+        }
+        sort(rowColumns.begin(), rowColumns.end());
+        rowColumns.erase(unique(rowColumns.begin(), rowColumns.end()), rowColumns.end());
+        columns.insert(columns.end(), rowColumns.begin(), rowColumns.end());
+        rowStarts[r + 1] = columns.size();
+
+        auto slot = [&](size_t column) {
+            return rowStarts[r] + (lower_bound(rowColumns.begin(), rowColumns.end(), column) - rowColumns.begin());
+        };
+        diagonalSlots[r] = slot(r);
+        for (size_t i = incidenceStarts[r]; i < incidenceStarts[r + 1]; i++)
+            incidences[i].slot = others[i] != STATIC ? slot(others[i]) : STATIC;
+    }
+    blocks.assign(columns.size(), glm::dmat3(0));
+    springBlocks.assign(springs.size(), glm::dmat3(0));
+}
+
+void BlockHessian::assemble(const vector<Particle>& particles, const vector<Spring>& springs,
+                            float airDampening, float deltaT)
+{
+    if (unknowns.size() != particles.size() || springBlocks.size() != springs.size())
+        setScene(particles, springs);
+
+    const double h = deltaT;
+    pool.parallelFor(0, springs.size(), [&](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; s++)
+        {
+            const Spring& spring = springs[s];
+            glm::dvec3 difference = glm::dvec3(particles[spring.p1].position - particles[spring.p2].position);
+            double length = glm::length(difference);
+            if (length <= 0)
+            {
+                springBlocks[s] = glm::dmat3(0);
+                continue;
+            }
+            glm::dvec3 direction = difference / length;
+            glm::dmat3 along = glm::outerProduct(direction, direction);
+            double stiffness = max((double)spring.stiffness, 0.0);
+            double stretch = max(1 - spring.restLength / length, 0.0);
+            springBlocks[s] = (h * h * stiffness) * (along + stretch * (glm::dmat3(1) - along))
+                            + (h * max((double)spring.dampening, 0.0)) * along;
+        }
+    }, MIN_CHUNK);
+
+    pool.parallelFor(0, particleIndices.size(), [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; r++)
+        {
+            for (size_t slot = rowStarts[r]; slot < rowStarts[r + 1]; slot++)
+                blocks[slot] = glm::dmat3(0);
+            glm::dmat3& diagonal = blocks[diagonalSlots[r]];
+            diagonal = glm::dmat3(particles[particleIndices[r]].mass + h * airDampening);
+            for (size_t i = incidenceStarts[r]; i < incidenceStarts[r + 1]; i++)
+            {
+                const glm::dmat3& block = springBlocks[incidences[i].spring];
+                diagonal += block;
+                if (incidences[i].slot != STATIC)
+                    blocks[incidences[i].slot] -= block;
+            }
+        }
+    }, MIN_CHUNK);
+}
+
+void BlockHessian::multiply(const vector<glm::dvec3>& x, vector<glm::dvec3>& result) const
+{
+    result.resize(particleIndices.size());
+    pool.parallelFor(0, particleIndices.size(), [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; r++)
+        {
+            glm::dvec3 sum(0);
+            for (size_t slot = rowStarts[r]; slot < rowStarts[r + 1]; slot++)
+                sum += blocks[slot] * x[columns[slot]];
+            result[r] = sum;
+        }
+    }, MIN_CHUNK);
+}
@@ -10,27 +10,262 @@
 #include <glm/gtc/matrix_access.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
 
 #include "Engine.h"
 #include "Shader.h"
 #include "VertexArray.h"
 #include "Spring.h"
+#include "Quantize.h"
+#include "GLState.h"
+#include "SceneFile.h"
+#include "MeshImport.h"
+#include "Ensemble.h"
+#include "ImplicitSolver.h"
+#include "ProjectiveSolver.h"
+#include "Sweep.h"
+#include "XpbdSolver.h"
 
 using namespace std;
 
+// glfwGetTime needs glfwInit, which headless runs never call
+static double secondsNow()
+{
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 Engine::Engine(int argc, const char *argv[])
 {
-	if (!initWindow())
+	argumentsValid_ = parseArguments(argc, argv);
+	if (!argumentsValid_)
+	{
+		windowInitialized_ = false;
+		return;
+	}
+	if (!ensembleFile.empty() || !sweepFile.empty())
+	{
+		// the scene is only a template for the runs, nothing is drawn
+		windowInitialized_ = false;
+		buildScene();
+		return;
+	}
+	if (headless ? !initHeadless() : !initWindow())
 	{
-		cerr << "Failed to  initilize GLFW" << endl;
+		if (headless)
+			cerr << "Failed to initialize a headless EGL context" << endl;
+		else
+			cerr << "Failed to  initilize GLFW" << endl;
 		windowInitialized_ = false;
+		return;
 	}
 	windowInitialized_ = true;
+	// otherwise every frame waits for the display and the benchmark only measures the refresh rate
+	if (benchmark && !headless)
+		glfwSwapInterval(0);
+	if (!capturePath.empty())
+		frameCapture = make_unique<FrameCapture>(800, 800, captureFormat, capturePath);
+	initOverlay();
 	initScene();
+	if (!recordPath.empty())
+	{
+		// the recording covers the scene the program starts on
+		if (recordInterval == 0)
+			recordInterval = updatesPerFrame;
+		trajectoryRecorder = make_unique<TrajectoryRecorder>(particles.size(), recordInterval * deltaT, recordStep);
+		if (!trajectoryRecorder->open(recordPath))
+			trajectoryRecorder.reset();
+	}
+	if (!playPath.empty())
+		initPlayback();
+	if (!publishName.empty() && statePublisher.open(publishName, particles.size()))
+		cout << "Publishing positions to shared memory " << SharedState::objectName(publishName) << endl;
+	if (!viewName.empty())
+	{
+		externalPositions.resize(particles.size() * 3);
+		cout << "Viewing positions from shared memory " << SharedState::objectName(viewName) << endl;
+	}
 	//initSingleSpringScene();
 	// initMultipleSpringsScene();
 }
 
+bool Engine::parseArguments(int argc, const char *argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "--quantize")
+			uploadMode = UploadMode::Quantized16;
+		else if (arg == "--impostors")
+			drawImpostors = true;
+		else if (arg == "--surface")
+			drawSurface = true;
+		else if (arg == "--timing")
+			showTimings = printTimingSummary = true;
+		else if (arg == "--gl-stats")
+			printGLStats = true;
+		else if (arg == "--lod")
+			lodMode = LodMode::LodByDistance;
+		else if (arg == "--lod-budget" && i + 1 < argc)
+		{
+			lodMode = LodMode::LodByFrameBudget;
+			lodBudget = stof(argv[++i]);
+		}
+		else if (arg == "--benchmark")
+			benchmark = true;
+		else if (arg == "--present-every" && i + 1 < argc)
+			presentInterval = max(1ul, stoul(argv[++i]));
+		else if (arg == "--scene" && i + 1 < argc)
+		{
+			sceneFile = argv[++i];
+			currentScene = Scene::FileScene;
+		}
+		else if (arg == "--export-scenes" && i + 1 < argc)
+			exportPrefix = argv[++i];
+		else if (arg == "--checkpoint" && i + 1 < argc)
+		{
+			checkpointPath = argv[++i];
+			if (checkpointInterval == 0)
+				checkpointInterval = 600;
+		}
+		else if (arg == "--checkpoint-every" && i + 1 < argc)
+			checkpointInterval = stoul(argv[++i]);
+		else if (arg == "--record" && i + 1 < argc)
+			recordPath = argv[++i];
+		else if (arg == "--record-every" && i + 1 < argc)
+			recordInterval = max(1ul, stoul(argv[++i]));
+		else if (arg == "--record-step" && i + 1 < argc)
+			recordStep = stof(argv[++i]);
+		else if (arg == "--play" && i + 1 < argc)
+			playPath = argv[++i];
+		else if (arg == "--play-speed" && i + 1 < argc)
+			playbackSpeed = stof(argv[++i]);
+		else if (arg == "--publish" && i + 1 < argc)
+			publishName = argv[++i];
+		else if (arg == "--view" && i + 1 < argc)
+			viewName = argv[++i];
+		else if (arg == "--grid-size" && i + 1 < argc)
+			gridSize = stoul(argv[++i]);
+		else if (arg == "--ensemble" && i + 1 < argc)
+			ensembleFile = argv[++i];
+		else if (arg == "--ensemble-seconds" && i + 1 < argc)
+			ensembleSeconds = stod(argv[++i]);
+		else if (arg == "--ensemble-output" && i + 1 < argc)
+			ensembleOutput = argv[++i];
+		else if (arg == "--sweep" && i + 1 < argc)
+			sweepFile = argv[++i];
+		else if (arg == "--sweep-output" && i + 1 < argc)
+			sweepOutput = argv[++i];
+		else if (arg == "--auto-timestep")
+			autoTimestep = true;
+		else if (arg == "--timestep-safety" && i + 1 < argc)
+		{
+			autoTimestep = true;
+			timestepSafety = stof(argv[++i]);
+		}
+		else if (arg == "--adaptive" && i + 1 < argc)
+		{
+			auto adaptive = make_unique<AdaptiveSolver>(stof(argv[++i]));
+			adaptiveSolver = adaptive.get();
+			solver = move(adaptive);
+			// the solver picks its own substeps, so a frame is a single update
+			deltaT = 1.0f / 60;
+			updatesPerFrame = 1;
+		}
+		else if (arg == "--xpbd" && i + 1 < argc)
+			xpbdIterations = stoul(argv[++i]);
+		else if (arg == "--xpbd-tolerance" && i + 1 < argc)
+			xpbdTolerance = stof(argv[++i]);
+		else if (arg == "--implicit" && i + 1 < argc)
+			implicitIterations = stoul(argv[++i]);
+		else if (arg == "--cg-tolerance" && i + 1 < argc)
+			cgTolerance = stod(argv[++i]);
+		else if (arg == "--newton" && i + 1 < argc)
+			newtonOptions.iterations = stoul(argv[++i]);
+		else if (arg == "--newton-tolerance" && i + 1 < argc)
+			newtonOptions.tolerance = stod(argv[++i]);
+		else if (arg == "--line-search-steps" && i + 1 < argc)
+			newtonOptions.lineSearchSteps = stoul(argv[++i]);
+		else if (arg == "--pd" && i + 1 < argc)
+			pdIterations = stoul(argv[++i]);
+		else if (arg == "--pd-tolerance" && i + 1 < argc)
+			pdTolerance = stod(argv[++i]);
+		else if (arg == "--pd-global" && i + 1 < argc)
+		{
+			if (!ProjectiveSolver::parseGlobalStep(argv[++i], pdGlobalStep))
+				cerr << "Unknown global step " << argv[i] << ", expected cholesky, jacobi, chebyshev or multigrid" << endl;
+		}
+		else if (arg == "--mg-cycles" && i + 1 < argc)
+			multigridOptions.cycles = max(1ul, stoul(argv[++i]));
+		else if (arg == "--mg-smoothing" && i + 1 < argc)
+			multigridOptions.smoothing = stoul(argv[++i]);
+		else if (arg == "--mg-levels" && i + 1 < argc)
+			multigridOptions.maxLevels = stoul(argv[++i]);
+		else if (arg == "--mg-coarsest" && i + 1 < argc)
+			multigridOptions.coarsestSize = stoul(argv[++i]);
+		else if (arg == "--headless")
+			headless = true;
+		else if (arg == "--frames" && i + 1 < argc)
+			frameLimit = stoul(argv[++i]);
+		else if (arg == "--capture" && i + 1 < argc)
+			capturePath = argv[++i];
+		else if (arg == "--capture-format" && i + 1 < argc)
+		{
+			if (!FrameCapture::parseFormat(argv[++i], captureFormat))
+				cerr << "Unknown capture format " << argv[i] << ", expected ppm, png or y4m" << endl;
+		}
+		else
+			cerr << "Unknown argument " << arg << endl;
+	}
+
+	// --frames wins, then a benchmark's fixed count, whether or not it's headless
+	if (frameLimit == 0 && benchmark)
+		frameLimit = BENCHMARK_FRAMES;
+	else if (frameLimit == 0 && headless)
+		frameLimit = HEADLESS_FRAMES;
+
+	// after the loop so the solvers' other options can come either side of them
+	if (newtonOptions.iterations > 0 && implicitIterations == 0)
+		implicitIterations = 200;
+	const uint solversChosen = (adaptiveSolver != nullptr) + (xpbdIterations > 0) + (implicitIterations > 0) + (pdIterations > 0);
+	if (solversChosen > 1)
+	{
+		cerr << "--adaptive, --xpbd, --implicit (or --newton) and --pd each pick the solver, only give one of them" << endl;
+		return false;
+	}
+	// ensembles and sweeps always step explicitly, at the timestep the scene picks
+	if (solversChosen > 0 && (!ensembleFile.empty() || !sweepFile.empty()))
+	{
+		cerr << "--ensemble and --sweep only run the explicit solver, they can't be combined with "
+			 << "--adaptive, --xpbd, --implicit, --newton or --pd" << endl;
+		return false;
+	}
+
+	if (xpbdIterations > 0)
+	{
+		solver = make_unique<XpbdSolver>(xpbdIterations, threadPool, xpbdTolerance);
+		// stable at a whole frame per step
+		deltaT = 1.0f / 60;
+		updatesPerFrame = 1;
+	}
+	if (implicitIterations > 0)
+	{
+		solver = make_unique<ImplicitSolver>(implicitIterations, threadPool, cgTolerance, newtonOptions);
+		deltaT = 1.0f / 60;
+		updatesPerFrame = 1;
+	}
+	if (pdIterations > 0)
+	{
+		solver = make_unique<ProjectiveSolver>(pdIterations, threadPool, pdGlobalStep, multigridOptions, pdTolerance);
+		deltaT = 1.0f / 60;
+		updatesPerFrame = 1;
+	}
+	return true;
+}
+
 bool Engine::initWindow()
 {
 	glfwInit();
@@ -66,6 +301,27 @@ bool Engine::initWindow()
 	return true; // if we made it here then success
 }
 
+/*
+	Same setup as initWindow but with an offscreen context, for running on
+	machines without a display. There is no way to close it, so
+	parseArguments gives it a frame limit when --frames doesn't.
+*/
+bool Engine::initHeadless()
+{
+	if (!offscreenContext.init(800, 800))
+		return false;
+
+	glEnable(GL_DEPTH_TEST);
+	return true;
+}
+
+bool Engine::running() const
+{
+	if (frameLimit > 0 && framesRendered >= frameLimit)
+		return false;
+	return headless || !glfwWindowShouldClose(window_.get());
+}
+
 void Engine::initSingleSpringScene()
 {
 	struct Particle staticParticle;
@@ -94,28 +350,13 @@ void Engine::initSingleSpringScene()
 	
 	springs.clear();		// clear previous
 	springs.push_back(spring);
+	indicies.clear();
+	surfaceMesh = SurfaceMesh();
 
 
-	shader = make_shared<Shader>("rsc/vertex.glsl", "rsc/fragment.glsl");
-	shader->link();
-
-	particlePositions.clear();
-	for (const auto& particle : particles)
-	{
-		for (uint i = 0; i < 3; i++)
-			particlePositions.push_back(particle.position[i]);
-	}
-
-	int componentsPerAttrib = 3;	
-	vertexArray = make_shared<VertexArray>(
-		&componentsPerAttrib, 1, particlePositions.data(), particlePositions.size(), GL_DYNAMIC_DRAW);
-
 	glm::mat4 identity(1.0f);
 	camera = Camera(identity, identity);
-
-	shader->use();
-	shader->setUniformMatrix4fv("projectionView", camera.getProjectionViewMatrix());
-	shader->unuse();
+	particleRadius = 0.02f;
 }
 
 void Engine::initMultipleSpringsScene()
@@ -127,6 +368,8 @@ void Engine::initMultipleSpringsScene()
 	staticParticle.netForce = glm::vec3(0,0,0);
 
 	springs.clear();		// clear previous
+	indicies.clear();
+	surfaceMesh = SurfaceMesh();
 	particles.clear();		// clear previous incase we are resetting scene
 	particles.push_back(staticParticle);
 
@@ -154,26 +397,9 @@ void Engine::initMultipleSpringsScene()
 		springs.push_back(spring);
 	}
 
-	shader = make_shared<Shader>("rsc/vertex.glsl", "rsc/fragment.glsl");
-	shader->link();
-
-	particlePositions.clear();
-	for (const auto& particle : particles)
-	{
-		for (uint i = 0; i < 3; i++)
-			particlePositions.push_back(particle.position[i]);
-	}
-
-	int componentsPerAttrib = 3;	
-	vertexArray = make_shared<VertexArray>(
-		&componentsPerAttrib, 1, particlePositions.data(), particlePositions.size(), GL_DYNAMIC_DRAW);
-
 	glm::mat4 identity(1.0f);
 	camera = Camera(identity, identity);
-
-	shader->use();
-	shader->setUniformMatrix4fv("projectionView", camera.getProjectionViewMatrix());
-	shader->unuse();
+	particleRadius = 0.02f;
 }
 
 void Engine::initJelloScene()
@@ -187,7 +413,7 @@ void Engine::initJelloScene()
 	dynamicParticle.velocity = glm::vec3(0,0,0);
 	dynamicParticle.netForce = glm::vec3(0,0,0);
 	
-	uint cubeSize = 4;
+	uint cubeSize = gridSize > 1 ? gridSize : 4;
 	float cubeLength = 5;
 	const float smallCubeLength = cubeLength / (cubeSize-1);
 	
@@ -221,6 +447,44 @@ void Engine::initJelloScene()
 		}
 	}
 
+	// Two triangles per grid square on each face of the cube, each flipped
+	// if needed so it faces away from the centre
+	glm::vec3 centre(0);
+	for (const auto& particle : particles)
+		centre += particle.position;
+	centre /= particles.size();
+
+	vector<uint> triangles;
+	auto index = [cubeSize](uint i, uint j, uint k) { return (i * cubeSize + j) * cubeSize + k; };
+	auto addTriangle = [&](uint a, uint b, uint c) {
+		const glm::vec3& pa = particles[a].position;
+		const glm::vec3& pb = particles[b].position;
+		const glm::vec3& pc = particles[c].position;
+		glm::vec3 outward = (pa + pb + pc) / 3.0f - centre;
+		if (glm::dot(glm::cross(pb - pa, pc - pa), outward) < 0)
+			swap(b, c);
+		triangles.insert(triangles.end(), {a, b, c});
+	};
+	auto addQuad = [&](uint a, uint b, uint c, uint d) {
+		addTriangle(a, b, c);
+		addTriangle(a, c, d);
+	};
+
+	const uint last = cubeSize - 1;
+	for (uint u = 0; u < last; u++)
+	{
+		for (uint v = 0; v < last; v++)
+		{
+			for (uint side : {0u, last})
+			{
+				addQuad(index(side, u, v), index(side, u+1, v), index(side, u+1, v+1), index(side, u, v+1));
+				addQuad(index(u, side, v), index(u+1, side, v), index(u+1, side, v+1), index(u, side, v+1));
+				addQuad(index(u, v, side), index(u+1, v, side), index(u+1, v+1, side), index(u, v+1, side));
+			}
+		}
+	}
+	surfaceMesh = SurfaceMesh(triangles);
+
 	const float MAX_DIST = sqrt( 3.0*smallCubeLength*smallCubeLength );
 	// cout << smallCubeLength << " " << MAX_DIST << endl;
 	// cout << glm::distance(particles[0].position, particles[21].position) << endl;
@@ -229,6 +493,12 @@ void Engine::initJelloScene()
 	spring.stiffness = 0.3;
 	spring.dampening = 1.0 * 2 * sqrt(dynamicParticle.mass * spring.stiffness);
 
+	auto gridCoord = [cubeSize](uint index) {
+		return glm::uvec3(index / (cubeSize * cubeSize), (index / cubeSize) % cubeSize, index % cubeSize);
+	};
+	particleGrid.size = glm::uvec3(cubeSize);
+	vector<uint> springLevels;
+
 	for (uint i = 0; i < particles.size(); i++)
 	{
 		for (uint j = i+1; j < particles.size(); j++)
@@ -244,38 +514,13 @@ void Engine::initJelloScene()
 
 				indicies.push_back(i);
 				indicies.push_back(j);
+				springLevels.push_back(gridSpringLod(gridCoord(i), gridCoord(j), glm::uvec3(last)));
 			}
 		}
 	}
+	sortSpringLods(springLevels);
 
-	shader = make_shared<Shader>("rsc/vertex.glsl", "rsc/fragment.glsl");
-	shader->link();
-
-	particlePositions.clear();
-	for (const auto& particle : particles)
-	{
-		for (uint i = 0; i < 3; i++)
-			particlePositions.push_back(particle.position[i]);
-	}
-
-	int componentsPerAttrib = 3;	
-	vertexArray = make_shared<VertexArray>(
-		&componentsPerAttrib, 1, particlePositions.data(), particlePositions.size(), GL_DYNAMIC_DRAW);
-	vertexArray->setElementBuffer(indicies.data(), indicies.size());
-
-	// Create ground
-	groundVertices = {
-		-10, -1, -10,
-		-10, -1, 10,
-		10, -1, -10,
-		10, -1, 10
-		};
-	groundIndices = {
-		0, 1, 2,
-		2, 1, 3
-	};
-	groundVertexArray = make_shared<VertexArray>(&componentsPerAttrib, 1, groundVertices.data(), groundVertices.size());
-	groundVertexArray->setElementBuffer(groundIndices.data(), indicies.size());
+	initGround(-1, 10);
 
 	glm::mat4 view = glm::lookAt(
 		// glm::vec3(1, 1.5, 4.2),		// position
@@ -285,11 +530,7 @@ void Engine::initJelloScene()
 	);
 	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)800 / 800, 0.1f, 100.0f);
 	camera = Camera(view, projection);
-
-	shader->use();
-	shader->setUniformMatrix4fv("projectionView", camera.getProjectionViewMatrix());
-	shader->unuse();
-	
+	particleRadius = 0.12f;
 }
 
 void Engine::initCurtainScene()
@@ -304,7 +545,7 @@ void Engine::initCurtainScene()
 	particle.velocity = glm::vec3(0,0,0);
 	particle.netForce = glm::vec3(0,0,0);
 	
-	uint squareSize = 8;
+	uint squareSize = gridSize > 1 ? gridSize : 8;
 	float squareLength = 5;
 	const float smallSquareLength = squareLength / (squareSize-1);
 	
@@ -335,6 +576,21 @@ void Engine::initCurtainScene()
 		}
 	}
 
+	// Two triangles per grid square, all wound the same way
+	vector<uint> triangles;
+	for (uint i = 0; i < squareSize - 1; i++)
+	{
+		for (uint j = 0; j < squareSize - 1; j++)
+		{
+			uint a = i * squareSize + j;
+			uint b = (i+1) * squareSize + j;
+			uint c = (i+1) * squareSize + j + 1;
+			uint d = i * squareSize + j + 1;
+			triangles.insert(triangles.end(), {a, b, c, a, c, d});
+		}
+	}
+	surfaceMesh = SurfaceMesh(triangles);
+
 	const float MAX_DIST = sqrt( 2.0*smallSquareLength*smallSquareLength );
 	// cout << smallCubeLength << " " << MAX_DIST << endl;
 	// cout << glm::distance(particles[0].position, particles[21].position) << endl;
@@ -344,6 +600,12 @@ void Engine::initCurtainScene()
 	spring.stiffness = 2.3;
 	spring.dampening = 1.5 * 2 * sqrt(particle.mass * spring.stiffness);
 
+	// the curtain is a grid that is one particle deep
+	auto gridCoord = [squareSize](uint index) { return glm::uvec3(index / squareSize, index % squareSize, 0); };
+	particleGrid.size = glm::uvec3(squareSize, squareSize, 1);
+	const glm::uvec3 last(squareSize - 1, squareSize - 1, 0);
+	vector<uint> springLevels;
+
 	for (uint i = 0; i < particles.size(); i++)
 	{
 		for (uint j = i+1; j < particles.size(); j++)
@@ -359,53 +621,505 @@ void Engine::initCurtainScene()
 
 				indicies.push_back(i);
 				indicies.push_back(j);
+				springLevels.push_back(gridSpringLod(gridCoord(i), gridCoord(j), last));
 			}
 		}
 	}
+	sortSpringLods(springLevels);
+
+	glm::mat4 view = glm::lookAt(
+		// glm::vec3(1, 1.5, 4.2),		// position
+		glm::vec3(0, 1, 16),
+		glm::vec3(0, 0, -1),		// looking
+		glm::vec3(0, 1, 0)		// up
+	);
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)800 / 800, 0.1f, 100.0f);
+	camera = Camera(view, projection);
+	particleRadius = 0.12f;
+}
+
+/*
+	A square floor the particles bounce off.
+*/
+void Engine::initGround(float height, float halfExtent)
+{
+	groundVertices = {
+		-halfExtent, height, -halfExtent,
+		-halfExtent, height, halfExtent,
+		halfExtent, height, -halfExtent,
+		halfExtent, height, halfExtent
+		};
+	groundIndices = {
+		0, 1, 2,
+		2, 1, 3
+	};
+	groundCollider = true;
+}
+
+/*
+	Loads sceneFile in place of a built in scene, either a scene file or a
+	mesh to build springs for. Falls back to the single spring if the file
+	can't be loaded.
+*/
+void Engine::initFileScene()
+{
+	SceneData scene;
+	bool loaded = MeshImport::canLoad(sceneFile) ? MeshImport::load(sceneFile, ImportOptions(), threadPool, scene)
+												 : SceneFile::load(sceneFile, scene);
+	if (!loaded || scene.particles.empty())
+	{
+		currentScene = Scene::SingleSpring;
+		initSingleSpringScene();
+		return;
+	}
+
+	particles = move(scene.particles);
+	springs = move(scene.springs);
+	indicies = move(scene.lineIndices);
+	fill(begin(lodIndexCounts), end(lodIndexCounts), indicies.size());
+	for (uint level = 0; level < LOD_LEVELS && level < scene.lodIndexCounts.size(); level++)
+		lodIndexCounts[level] = min<size_t>(scene.lodIndexCounts[level], indicies.size());
+	surfaceMesh = SurfaceMesh(scene.surfaceTriangles);
+	if (!scene.colliders.empty())
+		initGround(scene.colliders[0].height, scene.colliders[0].halfExtent);
+
+	camera = Camera(scene.camera.view, scene.camera.projection);
+	particleRadius = scene.camera.particleRadius;
+	simulationTime = scene.simulationTime;
+	if (simulationTime > 0)
+		cout << "Resuming at " << simulationTime << " s" << endl;
+}
+
+/*
+	Writes every built in scene to <prefix>_<scene>.scene, and the loaded or
+	imported one to <prefix>_file.scene.
+*/
+bool Engine::exportScenes()
+{
+	const char* names[] = { "single_spring", "multiple_springs", "jello", "curtain", "file" };
+	const uint lastScene = sceneFile.empty() ? TOTAL_SCENES - 1 : Scene::FileScene;
+	bool exported = true;
+	for (currentScene = 0; currentScene <= lastScene; currentScene++)
+	{
+		initScene();
+
+		string path = exportPrefix + "_" + names[currentScene] + ".scene";
+		if (SceneFile::save(path, sceneData()))
+			cout << "Exported " << path << endl;
+		else
+			exported = false;
+	}
+	return exported;
+}
+
+void Engine::stopRecording()
+{
+	if (!trajectoryRecorder)
+		return;
+	trajectoryRecorder->finish();
+	cout << "Recorded " << trajectoryRecorder->getFramesWritten() << " frames to " << recordPath << endl;
+	trajectoryRecorder.reset();
+}
+
+/*
+	Playback replaces the physics with a recording of the scene, so the scene
+	only supplies the springs, pins and surface to draw around it.
+*/
+void Engine::initPlayback()
+{
+	trajectoryPlayer = make_unique<TrajectoryPlayer>();
+	if (!trajectoryPlayer->open(playPath))
+	{
+		trajectoryPlayer.reset();
+		return;
+	}
+	if (trajectoryPlayer->getParticleCount() != particles.size())
+	{
+		cerr << playPath << " has " << trajectoryPlayer->getParticleCount() << " particles but the scene has "
+			 << particles.size() << ", pass the recorded scene with --scene" << endl;
+		trajectoryPlayer.reset();
+		return;
+	}
+	externalPositions.resize(particles.size() * 3);
+	cout << "Playing " << trajectoryPlayer->getFrameCount() << " frames from " << playPath << endl;
+}
+
+/*
+	The current scene and simulation state, as written to scene files.
+*/
+SceneData Engine::sceneData() const
+{
+	SceneData scene;
+	scene.particles = particles;
+	scene.springs = springs;
+	scene.lineIndices = indicies;
+	if (!indicies.empty())
+		scene.lodIndexCounts.assign(begin(lodIndexCounts), end(lodIndexCounts));
+	scene.surfaceTriangles = surfaceMesh.getParticleTriangles();
+	for (uint i = 0; i < particles.size(); i++)
+	{
+		if (particles[i].mass == 0)
+			scene.pins.push_back(i);
+	}
+	if (groundCollider)
+		scene.colliders.push_back({ groundVertices[1], groundVertices[3] });		// stored as xyz, x of the second corner
+	scene.camera = { camera.getViewMatrix(), camera.getProjectionMatrix(), particleRadius };
+	scene.simulationTime = simulationTime;
+	return scene;
+}
+
+/*
+	Copies the state on this thread and writes it on checkpointWriter, so
+	the simulation only pauses for the copy. The file is written next to
+	checkpointPath and renamed over it, so a crash mid write leaves the
+	previous checkpoint intact.
+*/
+void Engine::saveCheckpoint()
+{
+	// one write in flight at most, a slow disk shouldn't pile up copies
+	checkpointWriter.wait();
+
+	auto scene = make_shared<SceneData>(sceneData());
+	string path = checkpointPath;
+	checkpointWriter.submit([scene, path]() {
+		string temporary = path + ".tmp";
+		if (!SceneFile::save(temporary, *scene))
+			return;
+		if (rename(temporary.c_str(), path.c_str()) != 0)
+			cerr << "Failed to replace " << path << endl;
+		else
+			cout << "Checkpoint at " << scene->simulationTime << " s written to " << path << endl;
+	});
+}
+
+/*
+	Creates the shader and vertex array for the particles and springs the
+	current scene just built, and uploads the camera.
+*/
+void Engine::initBuffers()
+{
+	if (indicies.empty())
+		fill(begin(lodIndexCounts), end(lodIndexCounts), 0);
+
 	shader = make_shared<Shader>("rsc/vertex.glsl", "rsc/fragment.glsl");
 	shader->link();
 
+	particlePositions.clear();
 	for (const auto& particle : particles)
 	{
 		for (uint i = 0; i < 3; i++)
 			particlePositions.push_back(particle.position[i]);
 	}
+	quantizedPositions.resize(particlePositions.size());
 
 	int componentsPerAttrib = 3;	
 	vertexArray = make_shared<VertexArray>(
 		&componentsPerAttrib, 1, particlePositions.data(), particlePositions.size(), GL_DYNAMIC_DRAW);
-	vertexArray->setElementBuffer(indicies.data(), indicies.size());
+	if (!indicies.empty())
+		vertexArray->setElementBuffer(indicies.data(), indicies.size());
 
-	glm::mat4 view = glm::lookAt(
-		// glm::vec3(1, 1.5, 4.2),		// position
-		glm::vec3(0, 1, 16),
-		glm::vec3(0, 0, -1),		// looking
-		glm::vec3(0, 1, 0)		// up
-	);
-	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)800 / 800, 0.1f, 100.0f);
-	camera = Camera(view, projection);
+	impostorShader = make_shared<Shader>("rsc/impostor_vertex.glsl", "rsc/impostor_fragment.glsl");
+	impostorShader->link();
+	impostorVertexArray = make_shared<VertexArray>(*vertexArray, 1);
+
+	setUploadMode(uploadMode);
+
+	groundVertexArray.reset();
+	if (groundCollider)
+	{
+		groundVertexArray = make_shared<VertexArray>(&componentsPerAttrib, 1, groundVertices.data(), groundVertices.size());
+		groundVertexArray->setElementBuffer(groundIndices.data(), groundIndices.size());
+	}
+
+	surfaceVertexArray.reset();
+	if (!surfaceMesh.empty())
+	{
+		surfaceMesh.update(particles, threadPool);
+		const vector<float>& vertices = surfaceMesh.getVertices();
+		const vector<uint>& triangles = surfaceMesh.getTriangles();
+
+		int surfaceComponents[] = {3, 3};		// position, normal
+		surfaceVertexArray = make_shared<VertexArray>(
+			surfaceComponents, 2, vertices.data(), vertices.size(), GL_DYNAMIC_DRAW);
+		surfaceVertexArray->setElementBuffer(triangles.data(), triangles.size());
+
+		surfaceShader = make_shared<Shader>("rsc/surface_vertex.glsl", "rsc/surface_fragment.glsl");
+		surfaceShader->link();
+		surfaceShader->use();
+		surfaceShader->setUniformMatrix4fv("projectionView", camera.getProjectionViewMatrix());
+		surfaceShader->unuse();
+	}
 
 	shader->use();
 	shader->setUniformMatrix4fv("projectionView", camera.getProjectionViewMatrix());
 	shader->unuse();
+
+	impostorShader->use();
+	impostorShader->setUniformMatrix4fv("view", camera.getViewMatrix());
+	impostorShader->setUniformMatrix4fv("projection", camera.getProjectionMatrix());
+	impostorShader->setUniform1f("radius", particleRadius);
+	impostorShader->unuse();
+}
+
+/*
+	The coarsest level a spring between grid coordinates a and b still
+	shows up in. last is the largest coordinate on each axis.
+*/
+uint Engine::gridSpringLod(glm::uvec3 a, glm::uvec3 b, glm::uvec3 last) const
+{
+	bool onSurface = false;
+	uint axesChanged = 0;
+	for (uint axis = 0; axis < 3; axis++)
+	{
+		if (a[axis] == b[axis] && (a[axis] == 0 || a[axis] == last[axis]))
+			onSurface = true;		// both ends on the same face
+		if (a[axis] != b[axis])
+			axesChanged++;
+	}
+
+	if (!onSurface)
+		return LodLevel::AllSprings;
+	if (axesChanged != 1)
+		return LodLevel::SurfaceSprings;
+
+	// keep every other grid line plus the outline
+	for (uint axis = 0; axis < 3; axis++)
+	{
+		if (a[axis] == b[axis] && a[axis] % 2 != 0 && a[axis] != last[axis])
+			return LodLevel::StructuralSprings;
+	}
+	return LodLevel::DecimatedSprings;
+}
+
+/*
+	Reorders the spring line indices so the springs kept by the coarsest
+	level come first. Every level then draws a prefix of the same element
+	buffer, so switching levels never uploads anything.
+*/
+void Engine::sortSpringLods(const vector<uint>& springLevels)
+{
+	vector<uint> sorted;
+	sorted.reserve(indicies.size());
+	for (int level = LodLevel::LOD_LEVELS - 1; level >= 0; level--)
+	{
+		for (uint i = 0; i < springLevels.size(); i++)
+		{
+			if (springLevels[i] == (uint)level)
+			{
+				sorted.push_back(indicies[i*2]);
+				sorted.push_back(indicies[i*2 + 1]);
+			}
+		}
+		lodIndexCounts[level] = sorted.size();
+	}
+	indicies = sorted;
+}
+
+/*
+	Picks the spring level drawn this frame.
+*/
+void Engine::selectLod()
+{
+	if (lodMode == LodMode::LodByDistance)
+	{
+		// compare the object's bounding sphere, from the bounds uploadPositions found, to its distance from the camera
+		glm::vec3 minCorner = positionBounds.min, maxCorner = positionBounds.max;
+		glm::vec3 eye = glm::vec3(glm::inverse(camera.getViewMatrix())[3]);
+		float radius = glm::length(maxCorner - minCorner) * 0.5f;
+		float distance = glm::distance(eye, (minCorner + maxCorner) * 0.5f);
+		float screenSize = radius / max(distance, EPSILON);
+
+		if (screenSize > 0.2f)
+			lodLevel = LodLevel::AllSprings;
+		else if (screenSize > 0.1f)
+			lodLevel = LodLevel::SurfaceSprings;
+		else if (screenSize > 0.05f)
+			lodLevel = LodLevel::StructuralSprings;
+		else
+			lodLevel = LodLevel::DecimatedSprings;
+	}
+	else if (lodMode == LodMode::LodByFrameBudget)
+	{
+		// step one level at a time, with a gap between the two thresholds so it doesn't flicker
+		if (frameTime > lodBudget && lodLevel < LodLevel::DecimatedSprings)
+			lodLevel++;
+		else if (frameTime < lodBudget * 0.5f && lodLevel > LodLevel::AllSprings)
+			lodLevel--;
+	}
 }
 
 int Engine::run()
 {
+	if (!argumentsValid_)
+		return -1;
+	if (!ensembleFile.empty())
+		return runEnsemble() ? 0 : -1;
+	if (!sweepFile.empty())
+		return runSweep() ? 0 : -1;
 	if (!windowInitialized_)
 		return -1;
 
-	while (!glfwWindowShouldClose(window_.get()))
+	if (!exportPrefix.empty())
+	{
+		bool exported = exportScenes();
+		if (!headless)
+			glfwTerminate();
+		return exported ? 0 : -1;
+	}
+
+	lastFrameStart = secondsNow();
+	double benchmarkStart = lastFrameStart;
+	while (running())
 	{
-		processInput();
+		if (benchmark && framesRendered == BENCHMARK_WARMUP)
+		{
+			frameTimer.keepFrameTimes(true);
+			benchmarkStart = secondsNow();
+		}
+
+		double frameStart = secondsNow();
+		frameTime = (frameStart - lastFrameStart) * 1000;
+		lastFrameStart = frameStart;
+
+		frameTimer.beginFrame();
+		if (!headless)
+			processInput();
 		update();
 		render();
+		frameTimer.endFrame();
+		updateGLStats();
+		framesRendered++;
+
+		if (checkpointInterval > 0 && framesRendered % checkpointInterval == 0)
+			saveCheckpoint();
+	}
+
+	if (checkpointInterval > 0 && framesRendered % checkpointInterval != 0)
+		saveCheckpoint();
+	checkpointWriter.wait();
+	stopRecording();
+
+	if (frameCapture)
+	{
+		frameCapture->finish();
+		cout << "Captured " << framesRendered << " frames to " << capturePath
+			 << ", readback stalled " << frameCapture->getStalls() << " times" << endl;
+	}
+
+	if (adaptiveSolver && adaptiveSolver->getAccepted() > 0)
+	{
+		cout << "Adaptive steps to within " << adaptiveSolver->getTolerance() << ": "
+			 << adaptiveSolver->getAccepted() << " accepted, " << adaptiveSolver->getRejected() << " rejected, "
+			 << adaptiveSolver->getSmallestStep() << " to " << adaptiveSolver->getLargestStep() << " s, "
+			 << (double)adaptiveSolver->getAccepted() / max(framesRendered, 1u) << " per frame" << endl;
+	}
+	string statistics = solver->statistics();
+	if (!statistics.empty())
+		cout << statistics << endl;
+
+	if (printTimingSummary)
+		frameTimer.printSummary(cout);
+
+	if (benchmark)
+	{
+		// frames that were never presented can still be queued on the GPU
+		glFinish();
+		GLState::countCalls();
+		uint measured = framesRendered > BENCHMARK_WARMUP ? framesRendered - BENCHMARK_WARMUP : 0;
+		double seconds = secondsNow() - benchmarkStart;
+		frameTimer.printFrameStatistics(cout);
+		cout << fixed << setprecision(1) << "Throughput " << measured / seconds << " frames/s over " << measured
+			 << " frames, presenting every " << presentInterval << defaultfloat << endl;
 	}
 
-	glfwTerminate();
+	if (!headless)
+		glfwTerminate();
 	return 0;
 }
 
+/*
+	Runs every instance in ensembleFile on the current scene for
+	ensembleSeconds and writes a row of results for each.
+*/
+bool Engine::runEnsemble()
+{
+	vector<EnsembleInstance> instances;
+	if (!Ensemble::loadInstances(ensembleFile, instances))
+		return false;
+
+	Ensemble ensemble(particles, springs, instances);
+	ensemble.setParams(simulationParams());
+
+	size_t steps = llround(ensembleSeconds / deltaT);
+	double start = secondsNow();
+	ensemble.run(steps, threadPool);
+	double seconds = secondsNow() - start;
+	cerr << "Ran " << instances.size() << " instances of " << particles.size() << " particles for " << steps
+		 << " steps in " << seconds << " s" << endl;
+
+	if (ensembleOutput.empty())
+	{
+		ensemble.writeResults(cout);
+		return true;
+	}
+	ofstream out(ensembleOutput);
+	ensemble.writeResults(out);
+	if (!out)
+	{
+		cerr << "Failed to write " << ensembleOutput << endl;
+		return false;
+	}
+	return true;
+}
+
+/*
+	Runs every combination of the ranges in sweepFile on the current scene
+	and writes a row of results for each.
+*/
+bool Engine::runSweep()
+{
+	SweepSpec spec;
+	if (!Sweep::loadSpec(sweepFile, spec))
+		return false;
+	vector<SweepRun> runs = Sweep::expand(spec, gridSize, deltaT, airDampening);
+	if (spec.gridSize.count > 0 && currentScene != Scene::Jello && currentScene != Scene::Curtain)
+		cerr << "Grid size only changes the Jello and Curtain scenes" << endl;
+
+	// the builders fill in this Engine's scene, so build each grid size here rather than in the runs
+	map<uint, SweepScene> scenes;
+	for (const auto& run : runs)
+	{
+		if (scenes.count(run.gridSize))
+			continue;
+		if (run.gridSize != gridSize)
+		{
+			gridSize = run.gridSize;
+			buildScene();
+		}
+		scenes[run.gridSize] = { particles, springs, simulationParams() };
+	}
+
+	WorkStealingPool pool;
+	double start = secondsNow();
+	vector<SweepResult> results = Sweep::run(runs, scenes, spec.seconds, pool);
+	cerr << "Ran " << runs.size() << " runs of " << spec.seconds << " s on " << pool.size() << " threads in "
+		 << secondsNow() - start << " s, " << pool.getSteals() << " stolen" << endl;
+
+	if (sweepOutput.empty())
+	{
+		Sweep::writeResults(cout, runs, results);
+		return true;
+	}
+	ofstream out(sweepOutput);
+	Sweep::writeResults(out, runs, results);
+	if (!out)
+	{
+		cerr << "Failed to write " << sweepOutput << endl;
+		return false;
+	}
+	return true;
+}
+
 void Engine::processInput()
 {
 	if (glfwGetKey(window_.get(), GLFW_KEY_ESCAPE) == GLFW_PRESS)
@@ -416,17 +1130,108 @@ void Engine::processInput()
 	if (glfwGetKey(window_.get(), GLFW_KEY_R) == GLFW_PRESS && !rKeyHeld)
 	{
 		rKeyHeld = true;
-		initScene();
+		resetScene();
+	}
+
+	if (glfwGetKey(window_.get(), GLFW_KEY_C) == GLFW_PRESS && !cKeyHeld)
+	{
+		cKeyHeld = true;
+		saveCheckpoint();
+	}
+
+	if (glfwGetKey(window_.get(), GLFW_KEY_Q) == GLFW_PRESS && !qKeyHeld)
+	{
+		qKeyHeld = true;
+		setUploadMode(uploadMode == UploadMode::FullFloat ? UploadMode::Quantized16 : UploadMode::FullFloat);
+		cout << "Upload mode: " << (uploadMode == UploadMode::FullFloat ? "32 bit float" : "16 bit quantized") << endl;
+	}
+
+	if (glfwGetKey(window_.get(), GLFW_KEY_I) == GLFW_PRESS && !iKeyHeld)
+	{
+		iKeyHeld = true;
+		drawImpostors = !drawImpostors;
 	}
 
-	if (glfwGetKey(window_.get(), GLFW_KEY_RIGHT) == GLFW_PRESS && !rightKeyHeld)
+	if (glfwGetKey(window_.get(), GLFW_KEY_S) == GLFW_PRESS && !sKeyHeld)
+	{
+		sKeyHeld = true;
+		drawSurface = !drawSurface;
+	}
+
+	if (glfwGetKey(window_.get(), GLFW_KEY_L) == GLFW_PRESS && !lKeyHeld)
+	{
+		// cycle distance -> each fixed level -> distance
+		lKeyHeld = true;
+		if (lodMode != LodMode::LodFixed)
+		{
+			lodMode = LodMode::LodFixed;
+			lodLevel = LodLevel::AllSprings;
+		}
+		else if (lodLevel < LodLevel::DecimatedSprings)
+			lodLevel++;
+		else
+			lodMode = LodMode::LodByDistance;
+
+		if (lodMode == LodMode::LodFixed)
+			cout << "Spring level of detail: " << lodLevel << endl;
+		else
+			cout << "Spring level of detail: by distance" << endl;
+	}
+
+	if (glfwGetKey(window_.get(), GLFW_KEY_T) == GLFW_PRESS && !tKeyHeld)
+	{
+		tKeyHeld = true;
+		showTimings = !showTimings;
+		if (!showTimings)
+			glfwSetWindowTitle(window_.get(), "Roller Coaster");
+	}
+
+	if (trajectoryPlayer)
+	{
+		if (glfwGetKey(window_.get(), GLFW_KEY_SPACE) == GLFW_PRESS && !spaceKeyHeld)
+		{
+			spaceKeyHeld = true;
+			playbackPaused = !playbackPaused;
+		}
+
+		if (glfwGetKey(window_.get(), GLFW_KEY_B) == GLFW_PRESS && !bKeyHeld)
+		{
+			bKeyHeld = true;
+			playbackSpeed = -playbackSpeed;
+			cout << "Playback speed: " << playbackSpeed << endl;
+		}
+
+		if (glfwGetKey(window_.get(), GLFW_KEY_UP) == GLFW_PRESS && !upKeyHeld)
+		{
+			upKeyHeld = true;
+			playbackSpeed *= 2;
+			cout << "Playback speed: " << playbackSpeed << endl;
+		}
+
+		if (glfwGetKey(window_.get(), GLFW_KEY_DOWN) == GLFW_PRESS && !downKeyHeld)
+		{
+			downKeyHeld = true;
+			playbackSpeed /= 2;
+			cout << "Playback speed: " << playbackSpeed << endl;
+		}
+
+		// Left and Right scrub through the recording while held instead of changing scene
+		scrubDirection = 0;
+		if (glfwGetKey(window_.get(), GLFW_KEY_RIGHT) == GLFW_PRESS)
+			scrubDirection++;
+		if (glfwGetKey(window_.get(), GLFW_KEY_LEFT) == GLFW_PRESS)
+			scrubDirection--;
+	}
+
+	if (glfwGetKey(window_.get(), GLFW_KEY_RIGHT) == GLFW_PRESS && !rightKeyHeld && !trajectoryPlayer)
 	{
 		rightKeyHeld = true;
-		currentScene = currentScene >= TOTAL_SCENES - 1 ? TOTAL_SCENES - 1 : currentScene + 1;
+		uint lastScene = sceneFile.empty() ? TOTAL_SCENES - 1 : Scene::FileScene;
+		currentScene = currentScene >= lastScene ? lastScene : currentScene + 1;
 		initScene();
 	}
 
-	if (glfwGetKey(window_.get(), GLFW_KEY_LEFT) == GLFW_PRESS && !leftKeyHeld)
+	if (glfwGetKey(window_.get(), GLFW_KEY_LEFT) == GLFW_PRESS && !leftKeyHeld && !trajectoryPlayer)
 	{
 		leftKeyHeld = true;
 		currentScene = currentScene <= 0 ? 0 : currentScene - 1;
@@ -437,149 +1242,517 @@ void Engine::processInput()
 		rightKeyHeld = false;
 	if (glfwGetKey(window_.get(), GLFW_KEY_LEFT) == GLFW_RELEASE)
 		leftKeyHeld = false;
+	if (glfwGetKey(window_.get(), GLFW_KEY_C) == GLFW_RELEASE)
+		cKeyHeld = false;
 	if (glfwGetKey(window_.get(), GLFW_KEY_R) == GLFW_RELEASE)
 		rKeyHeld = false;
+	if (glfwGetKey(window_.get(), GLFW_KEY_Q) == GLFW_RELEASE)
+		qKeyHeld = false;
+	if (glfwGetKey(window_.get(), GLFW_KEY_I) == GLFW_RELEASE)
+		iKeyHeld = false;
+	if (glfwGetKey(window_.get(), GLFW_KEY_S) == GLFW_RELEASE)
+		sKeyHeld = false;
+	if (glfwGetKey(window_.get(), GLFW_KEY_L) == GLFW_RELEASE)
+		lKeyHeld = false;
+	if (glfwGetKey(window_.get(), GLFW_KEY_T) == GLFW_RELEASE)
+		tKeyHeld = false;
+	if (glfwGetKey(window_.get(), GLFW_KEY_SPACE) == GLFW_RELEASE)
+		spaceKeyHeld = false;
+	if (glfwGetKey(window_.get(), GLFW_KEY_B) == GLFW_RELEASE)
+		bKeyHeld = false;
+	if (glfwGetKey(window_.get(), GLFW_KEY_UP) == GLFW_RELEASE)
+		upKeyHeld = false;
+	if (glfwGetKey(window_.get(), GLFW_KEY_DOWN) == GLFW_RELEASE)
+		downKeyHeld = false;
 }
 
 void Engine::update()
 {
+	if (trajectoryPlayer)
+	{
+		frameTimer.beginCpu("playback");
+		updatePlayback();
+		frameTimer.endCpu("playback");
+	}
+	else if (!viewName.empty())
+	{
+		frameTimer.beginCpu("view");
+		updateView();
+		frameTimer.endCpu("view");
+	}
+	else
+	{
+		frameTimer.beginCpu("simulate");
+		simulate();
+		frameTimer.endCpu("simulate");
+	}
 
-	for (uint i = 0; i < updatesPerFrame; i++)
+	if (statePublisher.isOpen())
 	{
-		// calc spring force on each particle
-		for (auto& spring : springs)
-		{
-			glm::vec3 springForce = calcSpringForce(spring);
-			particles[spring.p1].netForce += springForce;
-			particles[spring.p2].netForce -= springForce;
-		}
+		frameTimer.beginCpu("publish");
+		statePublisher.publish(particles, simulationTime);
+		frameTimer.endCpu("publish");
+	}
 
-		// calc external forces on each particle then update position
-		for (auto& particle : particles)
-		{
-			particle.netForce += particle.mass * gravityForce;
-			particle.netForce += -airDampening * particle.velocity;
+	frameTimer.beginCpu("upload");
+	uploadPositions();
 
-			if (particle.mass > 0)		// if not a static particle
-			{
-				particle.velocity += (particle.netForce * particle.weight * deltaT);
-				particle.position += particle.velocity * deltaT;
+	if (drawSurface && surfaceVertexArray)
+	{
+		surfaceMesh.update(particles, threadPool);
+		const vector<float>& vertices = surfaceMesh.getVertices();
+		surfaceVertexArray->updateBuffer(vertices.data(), vertices.size());
+	}
+	frameTimer.endCpu("upload");
+}
 
-				if (currentScene == Scene::Jello)
-				{
-					checkCollisions(particle);
-				}
-			}
+void Engine::simulate()
+{
+	const SimulationParams params = simulationParams();
+	for (uint i = 0; i < updatesPerFrame; i++)
+	{
+		solver->step(particles, springs, params);
 
-			particle.netForce = glm::vec3(0, 0, 0);
+		if (trajectoryRecorder && ++substepsSinceRecord >= recordInterval)
+		{
+			substepsSinceRecord = 0;
+			trajectoryRecorder->record(particles, simulationTime + (i + 1) * deltaT);
 		}
 	}
 
-	for (uint i = 0; i < particles.size(); i++)
-	{
-		for (uint j = 0; j < 3; j++)
-			particlePositions[i*3 + j] = particles[i].position[j];
-		
-	}
-	vertexArray->updateBuffer(particlePositions.data(), particlePositions.size());
-	
+	simulationTime += updatesPerFrame * deltaT;
 }
 
-glm::vec3 Engine::calcSpringForce(const Spring& spring)
+SimulationParams Engine::simulationParams() const
 {
-	Particle& p1 = particles[spring.p1];
-	Particle& p2 = particles[spring.p2];
-	
-	glm::vec3 forceDirection = p1.position - p2.position;
-	float distance = glm::distance(p1.position, p2.position);
+	SimulationParams params;
+	params.deltaT = deltaT;
+	params.gravity = gravityForce;
+	params.airDampening = airDampening;
+	params.ground = groundCollider;
+	params.groundHeight = groundCollider ? groundVertices[1] : 0;		// stored as xyz
+	return params;
+}
 
-	forceDirection = glm::normalize(forceDirection);
-	// incase forceDirection is 0, then return
-	if ( abs(forceDirection[0]) >= 0.0 && abs(forceDirection[0]) < EPSILON && 
-		abs(forceDirection[1]) >= 0.0 && abs(forceDirection[1]) < EPSILON &&
-		abs(forceDirection[2]) >= 0.0 && abs(forceDirection[2]) < EPSILON )
+/*
+	Moves the playhead by a frame's worth of recording at playbackSpeed, or
+	by 1% of the recording a frame while scrubbing, looping at either end.
+*/
+void Engine::updatePlayback()
+{
+	const double frames = trajectoryPlayer->getFrameCount();
+	int direction = playbackSpeed < 0 ? -1 : 1;
+	if (scrubDirection != 0)
 	{
-		return glm::vec3(0, 0, 0);
+		direction = scrubDirection;
+		playhead += direction * max(1.0, frames * 0.01);
 	}
+	else if (!playbackPaused)
+		playhead += playbackSpeed * updatesPerFrame * deltaT / trajectoryPlayer->getFrameInterval();
+	playhead = fmod(playhead, frames);
+	if (playhead < 0)
+		playhead += frames;
+
+	double time;
+	if (!trajectoryPlayer->getFrame((size_t)playhead, direction, externalPositions.data(), time))
+	{
+		cerr << "Failed to read frame " << (size_t)playhead << " of " << playPath << ", pausing" << endl;
+		playbackPaused = true;
+		return;
+	}
+	for (uint i = 0; i < particles.size(); i++)
+		particles[i].position = glm::vec3(externalPositions[i*3], externalPositions[i*3 + 1], externalPositions[i*3 + 2]);
+	simulationTime = time;
+}
 
-	glm::vec3 hooksForce =  forceDirection * (-spring.stiffness * ( distance - spring.restLength));
-	// incase hooksForce is 0, then return
-	if ( abs(hooksForce[0]) >= 0.0 && abs(hooksForce[0]) < EPSILON && 
-		abs(hooksForce[1]) >= 0.0 && abs(hooksForce[1]) < EPSILON &&
-		abs(hooksForce[2]) >= 0.0 && abs(hooksForce[2]) < EPSILON )
+/*
+	Shows the newest positions another process published with --publish,
+	keeping the last ones when nothing new has arrived. Waits for the
+	publisher if it hasn't started, and picks it up again if it restarts.
+*/
+void Engine::updateView()
+{
+	if (stateReader.isAttached() && (stateReader.isClosed() || stateReader.getParticleCount() != particles.size()))
+		stateReader.detach();
+	if (!stateReader.isAttached())
 	{
-		return glm::vec3(0, 0, 0);
+		// attaching opens and maps the object, so not every frame
+		double now = secondsNow();
+		if (lastAttachAttempt >= 0 && now - lastAttachAttempt < 1)
+			return;
+		lastAttachAttempt = now;
+		if (!stateReader.attach(viewName))
+			return;
+		if (stateReader.getParticleCount() != particles.size())
+		{
+			cerr << SharedState::objectName(viewName) << " has " << stateReader.getParticleCount() << " particles but the scene has "
+				 << particles.size() << ", pass the published scene with --scene" << endl;
+			stateReader.detach();
+			return;
+		}
 	}
 
-	glm::vec3 hooksForceNorm = glm::normalize(hooksForce);
-	glm::vec3 dampeningForce = hooksForceNorm * -spring.dampening * ( (p1.velocity - p2.velocity) * hooksForce ); 
+	double time;
+	if (!stateReader.read(externalPositions.data(), time))
+		return;
+	for (uint i = 0; i < particles.size(); i++)
+		particles[i].position = glm::vec3(externalPositions[i*3], externalPositions[i*3 + 1], externalPositions[i*3 + 2]);
+	simulationTime = time;
+}
 
-	return hooksForce + dampeningForce;
+void Engine::setUploadMode(UploadMode mode)
+{
+	uploadMode = mode;
+	if (uploadMode == UploadMode::Quantized16)
+	{
+		vertexArray->setAttributeType(GL_UNSIGNED_SHORT, GL_TRUE);
+		impostorVertexArray->setAttributeType(GL_UNSIGNED_SHORT, GL_TRUE);
+	}
+	else
+	{
+		vertexArray->setAttributeType(GL_FLOAT, GL_FALSE);
+		impostorVertexArray->setAttributeType(GL_FLOAT, GL_FALSE);
+	}
+	uploadPositions();
 }
 
-void Engine::checkCollisions(Particle& particle)
+/*
+	Copies the particle positions into the vertex buffer. In quantized mode
+	every component is stored as a 16 bit fraction of the frame's bounding
+	box, which halves the bytes sent per frame. The vertex shader maps them
+	back with positionOffset and positionScale.
+*/
+void Engine::uploadPositions()
 {
-	float groundYPos = groundVertices[1];	// stored as xyz
-	if (particle.position[1] <= groundYPos)
+	for (uint i = 0; i < particles.size(); i++)
+	{
+		for (uint j = 0; j < 3; j++)
+			particlePositions[i*3 + j] = particles[i].position[j];
+		
+	}
+
+	if (uploadMode == UploadMode::Quantized16 || lodMode == LodMode::LodByDistance)
+		positionBounds = computeBounds(particlePositions.data(), particlePositions.size());
+
+	if (uploadMode == UploadMode::Quantized16)
+	{
+		quantizePositions(particlePositions.data(), particlePositions.size(), positionBounds, quantizedPositions.data());
+		vertexArray->updateBuffer(quantizedPositions.data(), quantizedPositions.size());
+		positionOffset = positionBounds.min;
+		positionScale = dequantizeScale(positionBounds);
+	}
+	else
 	{
-		particle.position[1] = groundYPos + EPSILON;
-		particle.velocity = -particle.velocity;
+		vertexArray->updateBuffer(particlePositions.data(), particlePositions.size());
+		positionOffset = glm::vec3(0);
+		positionScale = glm::vec3(1);
 	}
 }
 
 void Engine::render()
 {
+	frameTimer.beginCpu("render");
 	glClearColor(0.1f, 0.1f, 0.2f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	GLState::countCalls(2);
 
-	glPointSize(8);
-	shader->use();
+	if (drawImpostors)
+	{
+		frameTimer.beginGpu("impostors");
+		renderImpostors();
+		frameTimer.endGpu();
+	}
 
-	// for (auto& particle : particles)
-	// {
-	// 	particle.vao->use();
-	// 	shader->setUniformMatrix4fv("model", particle.model);
-	// 	glDrawArrays(GL_POINTS, 0, 1);
-	// 	particle.vao->unuse();
-	// }
+	const bool surfaceDrawn = drawSurface && surfaceVertexArray;
+	if (surfaceDrawn)
+	{
+		frameTimer.beginGpu("surface");
+		renderSurface();
+		frameTimer.endGpu();
+	}
 
+	glPointSize(8);
+	GLState::countCalls();
+	shader->use();
 	vertexArray->use();
 
-	shader->setUniform4fv("uColor", glm::vec4(1, 1, 1, 1));
-	glDrawArrays(GL_POINTS, 0, particles.size());
+	shader->setUniform3fv("positionOffset", positionOffset);
+	shader->setUniform3fv("positionScale", positionScale);
+	if (!drawImpostors)
+	{
+		frameTimer.beginGpu("points");
+		shader->setUniform4fv("uColor", glm::vec4(1, 1, 1, 1));
+		glDrawArrays(GL_POINTS, 0, particles.size());
+		GLState::countCalls();
+		frameTimer.endGpu();
+	}
 
-	if (currentScene == Scene::Jello || currentScene == Scene::Curtain)
+	if (!indicies.empty())
 	{
-		shader->setUniform4fv("uColor", glm::vec4(1, 0.9, 0, 1));
-		glDrawElements(GL_LINES, indicies.size(), GL_UNSIGNED_INT, 0);
+		if (!surfaceDrawn)
+		{
+			frameTimer.beginGpu("springs");
+			selectLod();
+			shader->setUniform4fv("uColor", glm::vec4(1, 0.9, 0, 1));
+			glDrawElements(GL_LINES, lodIndexCounts[lodLevel], GL_UNSIGNED_INT, 0);
+			GLState::countCalls();
+			frameTimer.endGpu();
+		}
 		
-		if (currentScene == Scene::Jello)
+		if (groundCollider)
 		{
+			frameTimer.beginGpu("ground");
 			shader->setUniform4fv("uColor", glm::vec4(0.03, 1, 0.7, 1));
+			shader->setUniform3fv("positionOffset", glm::vec3(0));		// ground is always full floats
+			shader->setUniform3fv("positionScale", glm::vec3(1));
 			groundVertexArray->use();
 			glDrawElements(GL_TRIANGLES, groundIndices.size(), GL_UNSIGNED_INT, 0);
+			GLState::countCalls();
+			frameTimer.endGpu();
 		}
 	} 
 	else
 	{
+		frameTimer.beginGpu("springs");
 		shader->setUniform4fv("uColor", glm::vec4(1, 0.9, 0, 1));
 		glDrawArrays(GL_LINE_STRIP, 0, particles.size());		
+		GLState::countCalls();
+		frameTimer.endGpu();
 	}
 	vertexArray->unuse();
 
 	shader->unuse();
-	glfwSwapBuffers(window_.get());
+
+	if (showTimings)
+	{
+		renderOverlay();
+		updateTimingTitle();
+	}
+	frameTimer.endCpu("render");
+
+	if (frameCapture)
+		frameCapture->capture();
+
+	if (headless)
+		return;
+	if (framesRendered % presentInterval == 0)
+		glfwSwapBuffers(window_.get());
+	else
+		glFlush();
+	GLState::countCalls();
 	glfwPollEvents();
 }
 
+/*
+	Draws every particle as a lit sphere in a single instanced call. Each
+	instance is a camera facing quad built in the vertex shader from
+	gl_VertexID, and the fragment shader carves the sphere out of it, so
+	no per particle work happens on the CPU.
+*/
+void Engine::renderImpostors()
+{
+	impostorShader->use();
+	impostorVertexArray->use();
+
+	impostorShader->setUniform3fv("positionOffset", positionOffset);
+	impostorShader->setUniform3fv("positionScale", positionScale);
+	impostorShader->setUniform4fv("uColor", glm::vec4(1, 1, 1, 1));
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, particles.size());
+	GLState::countCalls();
+
+	impostorVertexArray->unuse();
+	impostorShader->unuse();
+}
+
+void Engine::renderSurface()
+{
+	surfaceShader->use();
+	surfaceVertexArray->use();
+
+	surfaceShader->setUniform4fv("uColor", glm::vec4(1, 0.9, 0, 1));
+	glDrawElements(GL_TRIANGLES, surfaceMesh.getTriangles().size(), GL_UNSIGNED_INT, 0);
+	GLState::countCalls();
+
+	surfaceVertexArray->unuse();
+	surfaceShader->unuse();
+}
+
+/*
+	The timing overlay draws one bar per timed section, with the full
+	width of the screen standing for two 60 fps frames.
+*/
+const uint MAX_OVERLAY_BARS = 16;
+const float OVERLAY_FULL_WIDTH_MS = 2 * 1000.0f / 60;
+
+void Engine::initOverlay()
+{
+	overlayShader = make_shared<Shader>("rsc/vertex.glsl", "rsc/fragment.glsl");
+	overlayShader->link();
+	overlayShader->use();
+	overlayShader->setUniformMatrix4fv("projectionView", glm::mat4(1.0f));
+	overlayShader->unuse();
+
+	overlayVertices.assign((MAX_OVERLAY_BARS + 1) * 6 * 3, 0);		// + 1 for the 60 fps marker
+	int componentsPerAttrib = 3;
+	overlayVertexArray = make_shared<VertexArray>(
+		&componentsPerAttrib, 1, overlayVertices.data(), overlayVertices.size(), GL_DYNAMIC_DRAW);
+}
+
+void Engine::renderOverlay()
+{
+	struct Bar { float ms; glm::vec4 color; };
+	vector<Bar> bars;
+	bars.push_back({ (float)frameTimer.getFrameMs(), glm::vec4(1, 1, 1, 1) });
+	for (const auto& section : frameTimer.getSections())
+	{
+		if (section.samples > 0 && bars.size() < MAX_OVERLAY_BARS)
+			bars.push_back({ (float)section.averageMs, section.gpu ? glm::vec4(0.2, 0.8, 1, 1) : glm::vec4(1, 0.5, 0.1, 1) });
+	}
+
+	// two triangles per bar in normalized device coordinates
+	auto addRect = [this](uint slot, float left, float right, float top, float bottom) {
+		float corners[] = {
+			left, top, 0,  left, bottom, 0,  right, top, 0,
+			right, top, 0,  left, bottom, 0,  right, bottom, 0
+		};
+		copy(begin(corners), end(corners), overlayVertices.begin() + slot * 18);
+	};
+	const float left = -0.95f, width = 1.9f, height = 0.035f;
+	for (uint i = 0; i < bars.size(); i++)
+	{
+		float top = 0.95f - i * (height * 1.5f);
+		float length = min(bars[i].ms / OVERLAY_FULL_WIDTH_MS, 1.0f) * width;
+		addRect(i, left, left + max(length, 0.002f), top, top - height);
+	}
+	float marker = left + width * 0.5f;		// 16.7 ms
+	addRect(MAX_OVERLAY_BARS, marker - 0.002f, marker + 0.002f, 0.97f, 0.95f - bars.size() * height * 1.5f);
+	overlayVertexArray->updateBuffer(overlayVertices.data(), overlayVertices.size());
+
+	glDisable(GL_DEPTH_TEST);
+	GLState::countCalls();
+	overlayShader->use();
+	overlayVertexArray->use();
+	for (uint i = 0; i < bars.size(); i++)
+	{
+		overlayShader->setUniform4fv("uColor", bars[i].color);
+		glDrawArrays(GL_TRIANGLES, i * 6, 6);
+		GLState::countCalls();
+	}
+	overlayShader->setUniform4fv("uColor", glm::vec4(1, 0.2, 0.2, 1));
+	glDrawArrays(GL_TRIANGLES, MAX_OVERLAY_BARS * 6, 6);
+	overlayVertexArray->unuse();
+	overlayShader->unuse();
+	glEnable(GL_DEPTH_TEST);
+	GLState::countCalls(2);
+}
+
+/*
+	The overlay bars have no labels, so the numbers go in the window title,
+	refreshed twice a second to stay readable.
+*/
+void Engine::updateTimingTitle()
+{
+	double now = secondsNow();
+	if (headless || now - lastTitleUpdate < 0.5)
+		return;
+	lastTitleUpdate = now;
+
+	ostringstream title;
+	title << fixed << setprecision(2) << "frame " << frameTimer.getFrameMs() << " ms";
+	for (const auto& section : frameTimer.getSections())
+	{
+		if (section.samples > 0)
+			title << " | " << (section.gpu ? "gpu " : "cpu ") << section.name << " " << section.averageMs;
+	}
+	glfwSetWindowTitle(window_.get(), title.str().c_str());
+}
+
+/*
+	Averages the calls counted by GLState and prints them every 120 frames.
+*/
+void Engine::updateGLStats()
+{
+	GLState::Counters frame = GLState::endFrame();
+	if (!printGLStats)
+		return;
+
+	statFrames++;
+	statCallsIssued += frame.issued;
+	statCallsSkipped += frame.skipped;
+	if (statFrames == 120)
+	{
+		cout << "GL calls per frame: " << statCallsIssued / (float)statFrames << " issued, "
+			<< statCallsSkipped / (float)statFrames << " redundant binds skipped" << endl;
+		statFrames = statCallsIssued = statCallsSkipped = 0;
+	}
+}
+
 void Engine::initScene()
 {
+	stopRecording();
+	buildScene();
+	initBuffers();
+
+	resetParticles = particles;
+	resetTime = simulationTime;
+}
+
+/*
+	Fills in the current scene's particles, springs and collider without
+	touching GL, so it also works without a window.
+*/
+void Engine::buildScene()
+{
+	groundCollider = false;
+	simulationTime = 0;
+	particleGrid = ParticleGrid();
 	switch (currentScene)
 	{
 		case Scene::SingleSpring : initSingleSpringScene(); break;
 		case Scene::MultipleSprings : initMultipleSpringsScene(); break;
 		case Scene::Jello : initJelloScene(); break;
 		case Scene::Curtain : initCurtainScene(); break;
+		case Scene::FileScene : initFileScene(); break;
 		default : break;
 	}
-}
\ No newline at end of file
+	solver->setGrid(particleGrid);
+	solver->setScene(particles, springs, simulationParams());
+	string description = solver->describe();
+	if (!description.empty())
+		cout << description << endl;
+	// the bound is for the explicit integrator, the others pick their own steps
+	if (autoTimestep && dynamic_cast<ExplicitSolver*>(solver.get()))
+		chooseTimestep();
+}
+
+/*
+	Takes as few updates per frame as keeps the scene's stiffest springs
+	stable, with timestepSafety to spare, so soft scenes don't pay for the
+	fixed timestep the stiff ones need.
+*/
+void Engine::chooseTimestep()
+{
+	const float frameSeconds = 1.0f / 60;
+	float stable = ExplicitSolver::stableTimestep(particles, springs, simulationParams());
+	updatesPerFrame = max(1u, (uint)ceil(frameSeconds / (timestepSafety * stable)));
+	deltaT = frameSeconds / updatesPerFrame;
+	cout << "Timestep " << deltaT << " s, " << updatesPerFrame << " updates per frame (stable below "
+		 << stable << " s)" << endl;
+}
+
+/*
+	Puts the particles back where the scene builder left them. Springs never
+	change while simulating, so this is a copy rather than a rebuild. The
+	solver forgets whatever it carried over from the last step, so the run
+	starts over exactly as it did when the scene was built. A recording
+	ends here rather than going on with timestamps that jump back to the
+	start, so the file holds the run up to the reset.
+*/
+void Engine::resetScene()
+{
+	stopRecording();
+	particles = resetParticles;
+	simulationTime = resetTime;
+	playhead = 0;
+	solver->reset();
+}
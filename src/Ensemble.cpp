@@ -0,0 +1,361 @@
+#include "Ensemble.h"
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+/*
+    Loops over one particle's lanes. Taking each array as a separate
+    restrict parameter tells the compiler they never overlap, so the loops
+    vectorize without runtime overlap checks.
+*/
+namespace
+{
+    const size_t LANES = Ensemble::LANES;
+
+    void addLanes(float* __restrict target, const float* __restrict values, float sign)
+    {
+        for (size_t l = 0; l < LANES; l++)
+            target[l] += sign * values[l];
+    }
+
+    void addExternalForce(float* __restrict force, const float* __restrict velocity, float weightForce, float drag)
+    {
+        for (size_t l = 0; l < LANES; l++)
+        {
+            force[l] += weightForce;
+            force[l] += drag * velocity[l];
+        }
+    }
+
+    void integrate(float* __restrict position, float* __restrict velocity, const float* __restrict force,
+                   float weight, float deltaT)
+    {
+        for (size_t l = 0; l < LANES; l++)
+        {
+            velocity[l] += force[l] * weight * deltaT;
+            position[l] += velocity[l] * deltaT;
+        }
+    }
+
+    // see ExplicitSolver::step
+    void bounce(float* __restrict y, float* __restrict vx, float* __restrict vy, float* __restrict vz,
+                float surface, float height)
+    {
+        for (size_t l = 0; l < LANES; l++)
+        {
+            bool hit = y[l] <= height;
+            y[l] = hit ? surface : y[l];
+            vx[l] = hit ? -vx[l] : vx[l];
+            vy[l] = hit ? -vy[l] : vy[l];
+            vz[l] = hit ? -vz[l] : vz[l];
+        }
+    }
+}
+
+Ensemble::Ensemble(const vector<Particle>& particles, const vector<Spring>& springs,
+                   const vector<EnsembleInstance>& instances)
+: instances(instances), springs(springs), particleCount(particles.size())
+{
+    groups = (instances.size() + LANES - 1) / LANES;
+    const size_t lanes = groups * LANES;
+
+    for (const auto& particle : particles)
+    {
+        masses.push_back(particle.mass);
+        weights.push_back(particle.weight);
+    }
+
+    // spare lanes in the last group repeat the last instance and are never reported
+    stiffnessScales.resize(lanes);
+    dampeningScales.resize(lanes);
+    for (size_t i = 0; i < lanes; i++)
+    {
+        const EnsembleInstance& instance = instances[min(i, instances.size() - 1)];
+        stiffnessScales[i] = instance.stiffnessScale;
+        dampeningScales[i] = instance.dampeningScale;
+    }
+
+    const size_t size = lanes * particleCount;
+    for (auto array : { &px, &py, &pz, &vx, &vy, &vz, &fx, &fy, &fz })
+        array->assign(size, 0);
+    for (size_t group = 0; group < groups; group++)
+    {
+        for (size_t p = 0; p < particleCount; p++)
+        {
+            for (size_t l = 0; l < LANES; l++)
+            {
+                size_t i = (group * particleCount + p) * LANES + l;
+                px[i] = particles[p].position.x;
+                py[i] = particles[p].position.y;
+                pz[i] = particles[p].position.z;
+                vx[i] = particles[p].velocity.x;
+                vy[i] = particles[p].velocity.y;
+                vz[i] = particles[p].velocity.z;
+            }
+        }
+    }
+
+    incidenceStarts.assign(particleCount + 1, 0);
+    for (const auto& spring : springs)
+    {
+        incidenceStarts[spring.p1 + 1]++;
+        incidenceStarts[spring.p2 + 1]++;
+    }
+    for (size_t p = 0; p < particleCount; p++)
+        incidenceStarts[p + 1] += incidenceStarts[p];
+    incidences.resize(incidenceStarts[particleCount]);
+    vector<size_t> next(incidenceStarts.begin(), incidenceStarts.end() - 1);
+    for (size_t s = 0; s < springs.size(); s++)
+    {
+        incidences[next[springs[s].p1]++] = s * 2;
+        incidences[next[springs[s].p2]++] = s * 2 + 1;
+    }
+}
+
+void Ensemble::run(size_t steps, ThreadPool& pool)
+{
+    if (groups > pool.size() || springs.size() < MIN_CHUNK)
+    {
+        pool.parallelFor(0, groups, [&](size_t begin, size_t end) {
+            for (size_t group = begin; group < end; group++)
+            {
+                for (size_t i = 0; i < steps; i++)
+                    step(group);
+            }
+        }, 1);
+        return;
+    }
+
+    const size_t size = groups * springs.size() * LANES;
+    for (auto array : { &springFx, &springFy, &springFz })
+        array->assign(size, 0);
+    for (size_t i = 0; i < steps; i++)
+        stepSplit(pool);
+}
+
+/*
+    One ExplicitSolver::step for the LANES instances of a group, with the
+    same operations in the same order so an instance with both scales at 1
+    follows the scene exactly. Branches become selects and every lane loop
+    works on one particle's lanes, so each one vectorizes without checks.
+*/
+void Ensemble::step(size_t group)
+{
+    const size_t base = group * particleCount * LANES;
+    float* const FX = &fx[base];
+    float* const FY = &fy[base];
+    float* const FZ = &fz[base];
+
+    for (const auto& spring : springs)
+    {
+        const size_t a = spring.p1 * LANES;
+        const size_t b = spring.p2 * LANES;
+        float forceX[LANES], forceY[LANES], forceZ[LANES];
+        springForce(group, spring, forceX, forceY, forceZ);
+        addLanes(&FX[a], forceX, 1);
+        addLanes(&FY[a], forceY, 1);
+        addLanes(&FZ[a], forceZ, 1);
+        addLanes(&FX[b], forceX, -1);
+        addLanes(&FY[b], forceY, -1);
+        addLanes(&FZ[b], forceZ, -1);
+    }
+
+    for (size_t p = 0; p < particleCount; p++)
+        moveParticle(group, p);
+}
+
+/*
+    step for every group at once, each spring and then each particle its
+    own piece of work. A particle adds up its springs' forces in spring
+    order, which is the order step adds them in.
+*/
+void Ensemble::stepSplit(ThreadPool& pool)
+{
+    const size_t springCount = springs.size();
+    pool.parallelFor(0, groups * springCount, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            const size_t j = i * LANES;
+            springForce(i / springCount, springs[i % springCount], &springFx[j], &springFy[j], &springFz[j]);
+        }
+    }, MIN_CHUNK);
+
+    pool.parallelFor(0, groups * particleCount, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            const size_t group = i / particleCount;
+            const size_t p = i % particleCount;
+            const size_t f = i * LANES;
+            for (size_t k = incidenceStarts[p]; k < incidenceStarts[p + 1]; k++)
+            {
+                const size_t j = (group * springCount + incidences[k] / 2) * LANES;
+                const float sign = incidences[k] % 2 == 0 ? 1 : -1;
+                addLanes(&fx[f], &springFx[j], sign);
+                addLanes(&fy[f], &springFy[j], sign);
+                addLanes(&fz[f], &springFz[j], sign);
+            }
+            moveParticle(group, p);
+        }
+    }, MIN_CHUNK);
+}
+
+// see ExplicitSolver::springForce
+void Ensemble::springForce(size_t group, const Spring& spring, float* forceX, float* forceY, float* forceZ) const
+{
+    const size_t base = group * particleCount * LANES;
+    const float* const X = &px[base];
+    const float* const Y = &py[base];
+    const float* const Z = &pz[base];
+    const float* const VX = &vx[base];
+    const float* const VY = &vy[base];
+    const float* const VZ = &vz[base];
+    const float* const stiffnessScale = &stiffnessScales[group * LANES];
+    const float* const dampeningScale = &dampeningScales[group * LANES];
+
+    const size_t a = spring.p1 * LANES;
+    const size_t b = spring.p2 * LANES;
+    for (size_t l = 0; l < LANES; l++)
+    {
+        float dx = X[a + l] - X[b + l];
+        float dy = Y[a + l] - Y[b + l];
+        float dz = Z[a + l] - Z[b + l];
+        float lengthSquared = dx * dx + dy * dy + dz * dz;
+        float distance = sqrt(lengthSquared);
+        float inverseLength = 1 / sqrt(lengthSquared);
+        float nx = dx * inverseLength;
+        float ny = dy * inverseLength;
+        float nz = dz * inverseLength;
+
+        float stretch = -(spring.stiffness * stiffnessScale[l]) * (distance - spring.restLength);
+        float hx = nx * stretch;
+        float hy = ny * stretch;
+        float hz = nz * stretch;
+
+        // clamped so a spring at rest gives a finite force to discard rather than a NaN
+        float inverseHooks = 1 / sqrt(max(hx * hx + hy * hy + hz * hz, FLT_MIN));
+        float dampening = -(spring.dampening * dampeningScale[l]);
+        float x = hx + (hx * inverseHooks * dampening) * ((VX[a + l] - VX[b + l]) * hx);
+        float y = hy + (hy * inverseHooks * dampening) * ((VY[a + l] - VY[b + l]) * hy);
+        float z = hz + (hz * inverseHooks * dampening) * ((VZ[a + l] - VZ[b + l]) * hz);
+
+        // no force when the particles coincide or the spring is at rest
+        bool coincident = (fabs(nx) < EPSILON) & (fabs(ny) < EPSILON) & (fabs(nz) < EPSILON);
+        bool slack = (fabs(hx) < EPSILON) & (fabs(hy) < EPSILON) & (fabs(hz) < EPSILON);
+        float keep = !(coincident | slack);
+        forceX[l] = x * keep;
+        forceY[l] = y * keep;
+        forceZ[l] = z * keep;
+    }
+}
+
+// Adds gravity and drag to a particle's summed spring forces, moves it and clears the sum for the next step
+void Ensemble::moveParticle(size_t group, size_t p)
+{
+    const float deltaT = params.deltaT;
+    const float drag = -params.airDampening;
+    const size_t i = (group * particleCount + p) * LANES;
+    const glm::vec3 weightForce = masses[p] * params.gravity;
+    addExternalForce(&fx[i], &vx[i], weightForce.x, drag);
+    addExternalForce(&fy[i], &vy[i], weightForce.y, drag);
+    addExternalForce(&fz[i], &vz[i], weightForce.z, drag);
+
+    if (masses[p] > 0)      // the same for every instance
+    {
+        integrate(&px[i], &vx[i], &fx[i], weights[p], deltaT);
+        integrate(&py[i], &vy[i], &fy[i], weights[p], deltaT);
+        integrate(&pz[i], &vz[i], &fz[i], weights[p], deltaT);
+        if (params.ground)
+            bounce(&py[i], &vx[i], &vy[i], &vz[i], params.groundHeight + EPSILON, params.groundHeight);
+    }
+
+    fill_n(&fx[i], LANES, 0.0f);
+    fill_n(&fy[i], LANES, 0.0f);
+    fill_n(&fz[i], LANES, 0.0f);
+}
+
+vector<EnsembleResult> Ensemble::getResults() const
+{
+    vector<EnsembleResult> results;
+    for (size_t instance = 0; instance < instances.size(); instance++)
+    {
+        const size_t group = instance / LANES;
+        const size_t lane = instance % LANES;
+        EnsembleResult result = { true, 0, glm::vec3(0), 0 };
+        float totalMass = 0;
+        for (size_t p = 0; p < particleCount; p++)
+        {
+            size_t i = (group * particleCount + p) * LANES + lane;
+            glm::vec3 position(px[i], py[i], pz[i]);
+            glm::vec3 velocity(vx[i], vy[i], vz[i]);
+            if (!isfinite(position.x) || !isfinite(position.y) || !isfinite(position.z) ||
+                !isfinite(velocity.x) || !isfinite(velocity.y) || !isfinite(velocity.z))
+                result.stable = false;
+            if (masses[p] <= 0)
+                continue;
+
+            float speedSquared = glm::dot(velocity, velocity);
+            result.kineticEnergy += 0.5f * masses[p] * speedSquared;
+            result.centreOfMass += masses[p] * position;
+            result.maxSpeed = max(result.maxSpeed, sqrt(speedSquared));
+            totalMass += masses[p];
+        }
+        if (totalMass > 0)
+            result.centreOfMass /= totalMass;
+        results.push_back(result);
+    }
+    return results;
+}
+
+void Ensemble::writeResults(ostream& out) const
+{
+    vector<EnsembleResult> results = getResults();
+    out << "instance,stiffness_scale,dampening_scale,stable,kinetic_energy,centre_x,centre_y,centre_z,max_speed\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const EnsembleResult& result = results[i];
+        out << i << ',' << instances[i].stiffnessScale << ',' << instances[i].dampeningScale << ','
+            << result.stable << ',' << result.kineticEnergy << ','
+            << result.centreOfMass.x << ',' << result.centreOfMass.y << ',' << result.centreOfMass.z << ','
+            << result.maxSpeed << '\n';
+    }
+}
+
+bool Ensemble::loadInstances(const string& path, vector<EnsembleInstance>& instances)
+{
+    ifstream file(path);
+    if (!file)
+    {
+        cerr << "Failed to open " << path << endl;
+        return false;
+    }
+
+    instances.clear();
+    string line;
+    for (size_t lineNumber = 1; getline(file, line); lineNumber++)
+    {
+        istringstream fields(line);
+        string first;
+        if (!(fields >> first) || first[0] == '#')
+            continue;
+
+        EnsembleInstance instance;
+        fields.clear();
+        fields.seekg(0);
+        if (!(fields >> instance.stiffnessScale >> instance.dampeningScale))
+        {
+            cerr << path << ":" << lineNumber << ": expected a stiffness and a dampening scale" << endl;
+            return false;
+        }
+        instances.push_back(instance);
+    }
+    if (instances.empty())
+    {
+        cerr << path << " has no instances" << endl;
+        return false;
+    }
+    return true;
+}
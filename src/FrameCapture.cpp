@@ -0,0 +1,325 @@
+#include "FrameCapture.h"
+#include "GLState.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+FrameCapture::FrameCapture(int _width, int _height, Format _format, const string& _path, unsigned int writerThreads)
+: width(_width), height(_height), format(_format), path(_path), writers(max(writerThreads, 1u)),
+  maxFramesQueued(max(writerThreads, 1u) * FRAMES_PER_WRITER)
+{
+    glGenBuffers(RING_SIZE, pixelBuffers);
+    for (unsigned int i = 0; i < RING_SIZE; i++)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (format == Format::Y4M)
+    {
+        stream = fopen((path + ".y4m").c_str(), "wb");
+        if (!stream)
+            cerr << "Failed to open " << path << ".y4m for writing" << endl;
+        else
+            fprintf(stream, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n", width, height);
+    }
+}
+
+FrameCapture::~FrameCapture()
+{
+    finish();
+    glDeleteBuffers(RING_SIZE, pixelBuffers);
+    if (stream)
+        fclose(stream);
+}
+
+bool FrameCapture::parseFormat(const string& name, Format& format)
+{
+    if (name == "ppm")
+        format = Format::PPM;
+    else if (name == "png")
+        format = Format::PNG;
+    else if (name == "y4m")
+        format = Format::Y4M;
+    else
+        return false;
+    return true;
+}
+
+void FrameCapture::capture()
+{
+    // the slot about to be reused still holds the frame from RING_SIZE frames ago
+    unsigned int slot = nextSlot;
+    retire(slot, true);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);     // into the buffer, returns immediately
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    GLState::countCalls(5);
+    framesInRing[slot] = framesCaptured++;
+    nextSlot = (nextSlot + 1) % RING_SIZE;
+
+    // pick up any older readbacks that have already landed
+    for (unsigned int i = 1; i < RING_SIZE; i++)
+    {
+        if (!retire((slot + i) % RING_SIZE, false))
+            break;
+    }
+}
+
+/*
+    Maps a finished readback and passes a copy of it to the writers, first
+    waiting for room if they already have as many frames as they may. With
+    wait false a readback that hasn't finished yet is left for later and
+    false is returned.
+*/
+bool FrameCapture::retire(unsigned int slot, bool wait)
+{
+    if (!fences[slot])
+        return true;
+
+    GLenum status = glClientWaitSync(fences[slot], 0, 0);
+    GLState::countCalls();
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+        if (!wait)
+            return false;
+        stalls++;
+        glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        GLState::countCalls();
+    }
+    glDeleteSync(fences[slot]);
+    fences[slot] = 0;
+
+    auto rgba = make_shared< vector<unsigned char> >(width * height * 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+    const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, rgba->size(), GL_MAP_READ_BIT);
+    if (mapped)
+    {
+        memcpy(rgba->data(), mapped, rgba->size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        GLState::countCalls();
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    GLState::countCalls(4);     // delete sync, two binds and the map
+
+    unsigned int frame = framesInRing[slot];
+    {
+        unique_lock<mutex> lock(queueMutex);
+        frameWritten.wait(lock, [this] { return framesQueued < maxFramesQueued; });
+        framesQueued++;
+    }
+    writers.submit([this, frame, rgba]() {
+        write(frame, rgba);
+        lock_guard<mutex> lock(queueMutex);
+        framesQueued--;
+        frameWritten.notify_one();
+    });
+    return true;
+}
+
+void FrameCapture::finish()
+{
+    // oldest first so Y4M frames reach the writers in order
+    for (unsigned int i = 0; i < RING_SIZE; i++)
+        retire((nextSlot + i) % RING_SIZE, true);
+    writers.wait();
+    if (stream)
+        fflush(stream);
+}
+
+void FrameCapture::write(unsigned int frame, shared_ptr< vector<unsigned char> > rgba)
+{
+    switch (format)
+    {
+        case Format::PPM : writePPM(frame, *rgba); break;
+        case Format::PNG : writePNG(frame, *rgba); break;
+        case Format::Y4M : writeY4M(frame, *rgba); break;
+    }
+}
+
+string FrameCapture::framePath(unsigned int frame, const char* extension) const
+{
+    char number[16];
+    snprintf(number, sizeof(number), "_%05u.", frame);
+    return path + number + extension;
+}
+
+void FrameCapture::writePPM(unsigned int frame, const vector<unsigned char>& rgba)
+{
+    vector<unsigned char> rgb(width * height * 3);
+    for (int y = 0; y < height; y++)
+    {
+        // OpenGL rows start at the bottom
+        const unsigned char* in = &rgba[(height - 1 - y) * width * 4];
+        unsigned char* out = &rgb[y * width * 3];
+        for (int x = 0; x < width; x++)
+        {
+            out[x*3] = in[x*4];
+            out[x*3 + 1] = in[x*4 + 1];
+            out[x*3 + 2] = in[x*4 + 2];
+        }
+    }
+
+    FILE* file = fopen(framePath(frame, "ppm").c_str(), "wb");
+    if (!file)
+        return;
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    fwrite(rgb.data(), 1, rgb.size(), file);
+    fclose(file);
+}
+
+namespace
+{
+    unsigned int crc32(const unsigned char* data, size_t size, unsigned int crc = 0)
+    {
+        static unsigned int table[256];
+        static bool tableBuilt = [] {
+            for (unsigned int n = 0; n < 256; n++)
+            {
+                unsigned int c = n;
+                for (int k = 0; k < 8; k++)
+                    c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                table[n] = c;
+            }
+            return true;
+        }();
+        (void)tableBuilt;
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++)
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    void appendBigEndian(vector<unsigned char>& out, unsigned int value)
+    {
+        out.push_back(value >> 24);
+        out.push_back(value >> 16);
+        out.push_back(value >> 8);
+        out.push_back(value);
+    }
+
+    void appendChunk(vector<unsigned char>& out, const char* type, const vector<unsigned char>& data)
+    {
+        appendBigEndian(out, data.size());
+        size_t typeStart = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        appendBigEndian(out, crc32(&out[typeStart], out.size() - typeStart));
+    }
+}
+
+/*
+    PNG with the image data in stored (uncompressed) deflate blocks, which
+    keeps the writer free of a zlib dependency and cheap to encode.
+*/
+void FrameCapture::writePNG(unsigned int frame, const vector<unsigned char>& rgba)
+{
+    // filter byte 0 then the RGB row, top row first
+    vector<unsigned char> raw;
+    raw.reserve(height * (width * 3 + 1));
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char* in = &rgba[(height - 1 - y) * width * 4];
+        raw.push_back(0);
+        for (int x = 0; x < width; x++)
+            raw.insert(raw.end(), in + x*4, in + x*4 + 3);
+    }
+
+    vector<unsigned char> zlib = { 0x78, 0x01 };
+    unsigned int adlerA = 1, adlerB = 0;
+    for (size_t offset = 0; offset < raw.size(); offset += 65535)
+    {
+        unsigned int blockSize = min<size_t>(65535, raw.size() - offset);
+        bool last = offset + blockSize == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(blockSize & 0xFF);
+        zlib.push_back(blockSize >> 8);
+        zlib.push_back(~blockSize & 0xFF);
+        zlib.push_back((~blockSize >> 8) & 0xFF);
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+        for (size_t i = offset; i < offset + blockSize; i++)
+        {
+            adlerA = (adlerA + raw[i]) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+        }
+    }
+    appendBigEndian(zlib, (adlerB << 16) | adlerA);
+
+    vector<unsigned char> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    header.insert(header.end(), { 8, 2, 0, 0, 0 });     // 8 bit RGB, no interlace
+
+    vector<unsigned char> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    appendChunk(png, "IHDR", header);
+    appendChunk(png, "IDAT", zlib);
+    appendChunk(png, "IEND", {});
+
+    FILE* file = fopen(framePath(frame, "png").c_str(), "wb");
+    if (!file)
+        return;
+    fwrite(png.data(), 1, png.size(), file);
+    fclose(file);
+}
+
+/*
+    Converts to full range BT.601 YUV 4:2:0 in parallel, then appends to the
+    stream once every earlier frame has been appended.
+*/
+void FrameCapture::writeY4M(unsigned int frame, const vector<unsigned char>& rgba)
+{
+    const int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+    vector<unsigned char> yuv(width * height + 2 * chromaWidth * chromaHeight);
+    unsigned char* lumaPlane = yuv.data();
+    unsigned char* uPlane = lumaPlane + width * height;
+    unsigned char* vPlane = uPlane + chromaWidth * chromaHeight;
+
+    auto pixel = [&](int x, int y) { return &rgba[((height - 1 - y) * width + x) * 4]; };
+    auto clampByte = [](float value) { return (unsigned char)min(max(value + 0.5f, 0.0f), 255.0f); };
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            const unsigned char* p = pixel(x, y);
+            lumaPlane[y * width + x] = clampByte(0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2]);
+        }
+    }
+    for (int y = 0; y < chromaHeight; y++)
+    {
+        for (int x = 0; x < chromaWidth; x++)
+        {
+            // average the 2x2 block
+            float r = 0, g = 0, b = 0;
+            int samples = 0;
+            for (int dy = 0; dy < 2 && y*2 + dy < height; dy++)
+            {
+                for (int dx = 0; dx < 2 && x*2 + dx < width; dx++)
+                {
+                    const unsigned char* p = pixel(x*2 + dx, y*2 + dy);
+                    r += p[0]; g += p[1]; b += p[2];
+                    samples++;
+                }
+            }
+            r /= samples; g /= samples; b /= samples;
+            uPlane[y * chromaWidth + x] = clampByte(128 - 0.168736f * r - 0.331264f * g + 0.5f * b);
+            vPlane[y * chromaWidth + x] = clampByte(128 + 0.5f * r - 0.418688f * g - 0.081312f * b);
+        }
+    }
+
+    unique_lock<mutex> lock(streamMutex);
+    streamTurn.wait(lock, [this, frame] { return nextStreamFrame == frame; });
+    if (stream)
+    {
+        fputs("FRAME\n", stream);
+        fwrite(yuv.data(), 1, yuv.size(), stream);
+    }
+    nextStreamFrame++;
+    streamTurn.notify_all();
+}
@@ -0,0 +1,179 @@
+#include "FrameTimer.h"
+#include "GLState.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <string>
+
+FrameTimer::~FrameTimer()
+{
+    for (auto& sectionQueries : queries)
+    {
+        if (sectionQueries.ids[0])
+            glDeleteQueries(LATENCY, sectionQueries.ids);
+    }
+}
+
+size_t FrameTimer::findSection(const std::string& name, bool gpu)
+{
+    for (size_t i = 0; i < sections.size(); i++)
+    {
+        if (sections[i].name == name && sections[i].gpu == gpu)
+            return i;
+    }
+
+    Section section;
+    section.name = name;
+    section.gpu = gpu;
+    sections.push_back(section);
+    queries.emplace_back();
+    cpuStarts.emplace_back();
+    if (gpu)
+    {
+        glGenQueries(LATENCY, queries.back().ids);
+
+        // Mesa's software rasterizers only rasterize when commands are flushed,
+        // so without a flush a section would time command recording only
+        std::string renderer = (const char*)glGetString(GL_RENDERER);
+        flushSections = renderer.find("llvmpipe") != std::string::npos ||
+            renderer.find("softpipe") != std::string::npos;
+    }
+    return sections.size() - 1;
+}
+
+void FrameTimer::addSample(Section& section, double ms)
+{
+    // exponential average keeps the overlay readable without storing history
+    section.averageMs = section.samples == 0 ? ms : section.averageMs * 0.95 + ms * 0.05;
+    section.totalMs += ms;
+    section.maxMs = std::max(section.maxMs, ms);
+    section.samples++;
+}
+
+void FrameTimer::collect(size_t section, unsigned int slot)
+{
+    GpuQueries& sectionQueries = queries[section];
+    if (!sectionQueries.pending[slot])
+        return;
+
+    GLuint available = 0;
+    glGetQueryObjectuiv(sectionQueries.ids[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+    GLState::countCalls();
+    if (!available)
+        return;
+
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(sectionQueries.ids[slot], GL_QUERY_RESULT, &nanoseconds);
+    GLState::countCalls();
+    sectionQueries.pending[slot] = false;
+    addSample(sections[section], nanoseconds / 1.0e6);
+}
+
+void FrameTimer::beginFrame()
+{
+    frameStart = Clock::now();
+    frameStarted = true;
+    frameIndex++;
+
+    for (size_t i = 0; i < sections.size(); i++)
+    {
+        if (!sections[i].gpu)
+            continue;
+        for (unsigned int slot = 0; slot < LATENCY; slot++)
+            collect(i, slot);
+    }
+}
+
+void FrameTimer::endFrame()
+{
+    if (!frameStarted)
+        return;
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count();
+    addSample(frame, ms);
+    if (keepingFrameTimes)
+        frameTimes.push_back(ms);
+}
+
+void FrameTimer::beginGpu(const std::string& name)
+{
+    size_t section = findSection(name, true);
+    unsigned int slot = frameIndex % LATENCY;
+
+    // still waiting on the result from LATENCY frames ago, skip this frame
+    // rather than block on it
+    collect(section, slot);
+    if (queries[section].pending[slot])
+        return;
+
+    glBeginQuery(GL_TIME_ELAPSED, queries[section].ids[slot]);
+    GLState::countCalls();
+    queries[section].pending[slot] = true;
+    activeGpuSection = section;
+}
+
+void FrameTimer::endGpu()
+{
+    if (activeGpuSection < 0)
+        return;
+    if (flushSections)
+    {
+        glFlush();
+        GLState::countCalls();
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    GLState::countCalls();
+    activeGpuSection = -1;
+}
+
+void FrameTimer::beginCpu(const std::string& name)
+{
+    cpuStarts[findSection(name, false)] = Clock::now();
+}
+
+void FrameTimer::endCpu(const std::string& name)
+{
+    size_t section = findSection(name, false);
+    addSample(sections[section], std::chrono::duration<double, std::milli>(Clock::now() - cpuStarts[section]).count());
+}
+
+void FrameTimer::printSummary(std::ostream& out) const
+{
+    if (frame.samples == 0)
+        return;
+
+    out << "Frame timing over " << frame.samples << " frames (mean / max ms)" << std::endl;
+    out << std::fixed << std::setprecision(3);
+    out << "  " << std::setw(8) << "cpu" << "  " << std::setw(16) << std::left << "frame" << std::right
+        << std::setw(9) << frame.totalMs / frame.samples << std::setw(9) << frame.maxMs << std::endl;
+    for (const auto& section : sections)
+    {
+        if (section.samples == 0)
+            continue;
+        out << "  " << std::setw(8) << (section.gpu ? "gpu" : "cpu") << "  " << std::setw(16) << std::left << section.name << std::right
+            << std::setw(9) << section.totalMs / section.samples << std::setw(9) << section.maxMs << std::endl;
+    }
+    out << std::defaultfloat;
+}
+
+void FrameTimer::printFrameStatistics(std::ostream& out) const
+{
+    if (frameTimes.empty())
+        return;
+
+    std::vector<double> sorted = frameTimes;
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0;
+    for (double ms : sorted)
+        total += ms;
+    // nearest rank
+    auto percentile = [&sorted](double p) {
+        size_t rank = (size_t)std::ceil(p * sorted.size());
+        return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+    };
+
+    out << "Frame times over " << sorted.size() << " frames (ms)" << std::endl;
+    out << std::fixed << std::setprecision(3);
+    out << "  min " << sorted.front() << "  mean " << total / sorted.size() << "  median " << percentile(0.5)
+        << "  p95 " << percentile(0.95) << "  max " << sorted.back() << std::endl;
+    out << std::defaultfloat;
+}
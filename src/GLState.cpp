@@ -0,0 +1,91 @@
+#include "GLState.h"
+
+GLuint GLState::vertexArray = 0;
+GLuint GLState::arrayBuffer = 0;
+GLuint GLState::program = 0;
+std::unordered_map<GLuint, GLuint> GLState::elementBuffers;
+GLState::Counters GLState::counters;
+
+void GLState::bindVertexArray(GLuint id)
+{
+    if (id == vertexArray)
+    {
+        counters.skipped++;
+        return;
+    }
+    glBindVertexArray(id);
+    vertexArray = id;
+    counters.issued++;
+}
+
+void GLState::bindBuffer(GLenum target, GLuint id)
+{
+    GLuint* bound = nullptr;
+    if (target == GL_ARRAY_BUFFER)
+        bound = &arrayBuffer;
+    else if (target == GL_ELEMENT_ARRAY_BUFFER)
+        bound = &elementBuffers[vertexArray];
+
+    if (bound && *bound == id)
+    {
+        counters.skipped++;
+        return;
+    }
+    glBindBuffer(target, id);
+    if (bound)
+        *bound = id;
+    counters.issued++;
+}
+
+void GLState::useProgram(GLuint id)
+{
+    if (id == program)
+    {
+        counters.skipped++;
+        return;
+    }
+    glUseProgram(id);
+    program = id;
+    counters.issued++;
+}
+
+void GLState::deleteVertexArray(GLuint id)
+{
+    glDeleteVertexArrays(1, &id);
+    elementBuffers.erase(id);
+    if (vertexArray == id)
+        vertexArray = 0;
+}
+
+void GLState::deleteBuffer(GLuint id)
+{
+    glDeleteBuffers(1, &id);
+    if (arrayBuffer == id)
+        arrayBuffer = 0;
+    for (auto& binding : elementBuffers)
+    {
+        if (binding.second == id)
+            binding.second = 0;
+    }
+}
+
+void GLState::deleteProgram(GLuint id)
+{
+    // a program in use is only flagged for deletion and stays bound, and its
+    // name could be handed out again, so stop using it first
+    if (program == id)
+        useProgram(0);
+    glDeleteProgram(id);
+}
+
+void GLState::countCalls(unsigned int calls)
+{
+    counters.issued += calls;
+}
+
+GLState::Counters GLState::endFrame()
+{
+    Counters frame = counters;
+    counters = Counters();
+    return frame;
+}
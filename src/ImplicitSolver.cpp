@@ -0,0 +1,359 @@
+#include "ImplicitSolver.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+using namespace std;
+
+ImplicitSolver::ImplicitSolver(unsigned int maxIterations, ThreadPool& pool, double tolerance,
+                               const NewtonOptions& newton)
+: maxIterations(max(maxIterations, 1u)), pool(pool), tolerance(tolerance), newton(newton), hessian(pool)
+{
+}
+
+void ImplicitSolver::setScene(const vector<Particle>& particles, const vector<Spring>& springs, const SimulationParams&)
+{
+    hessian.setScene(particles, springs);
+    lastVelocityChange.assign(hessian.rows(), glm::dvec3(0));
+}
+
+void ImplicitSolver::reset()
+{
+    fill(lastVelocityChange.begin(), lastVelocityChange.end(), glm::dvec3(0));
+}
+
+string ImplicitSolver::describe() const
+{
+    ostringstream text;
+    if (newton.iterations > 0)
+        text << "Implicit Euler by up to " << newton.iterations << " Newton iterations to " << newton.tolerance << " m/s, ";
+    else
+        text << "Linearized implicit Euler, ";
+    text << hessian.rows() << " unknowns in " << hessian.getBlockCount()
+         << " blocks, at most " << maxIterations << " conjugate gradient iterations to " << tolerance;
+    return text.str();
+}
+
+string ImplicitSolver::statistics() const
+{
+    if (steps == 0 || solves == 0)
+        return string();
+    ostringstream text;
+    text << "Implicit Euler took ";
+    if (newton.iterations > 0)
+        text << (double)newtonIterations / steps << " Newton iterations per step, " << backtracks << " backtracks, ";
+    text << (double)totalIterations / solves << " conjugate gradient iterations per solve over " << steps << " steps";
+    return text.str();
+}
+
+/*
+    The right hand side, M v + deltaT f. Springs pull on both ends, so
+    they're added up a spring at a time like ExplicitSolver does.
+*/
+void ImplicitSolver::gatherForces(const vector<Particle>& particles, const vector<Spring>& springs,
+                                  const SimulationParams& params)
+{
+    const size_t rows = hessian.rows();
+    rhs.resize(rows);
+    for (size_t r = 0; r < rows; r++)
+    {
+        const Particle& particle = particles[hessian.particleOf(r)];
+        rhs[r] = glm::dvec3(particle.velocity + params.gravity * params.deltaT) * (double)particle.mass;
+    }
+    for (const auto& spring : springs)
+    {
+        glm::dvec3 difference = glm::dvec3(particles[spring.p1].position - particles[spring.p2].position);
+        double length = glm::length(difference);
+        if (length <= 0)
+            continue;
+        glm::dvec3 force = difference * (-max((double)spring.stiffness, 0.0) * (length - spring.restLength) / length);
+        size_t a = hessian.rowOf(spring.p1);
+        size_t b = hessian.rowOf(spring.p2);
+        if (a != BlockHessian::STATIC)
+            rhs[a] += force * (double)params.deltaT;
+        if (b != BlockHessian::STATIC)
+            rhs[b] -= force * (double)params.deltaT;
+    }
+}
+
+double ImplicitSolver::dot(const vector<glm::dvec3>& a, const vector<glm::dvec3>& b) const
+{
+    double sum = 0;
+    for (size_t r = 0; r < a.size(); r++)
+        sum += glm::dot(a[r], b[r]);
+    return sum;
+}
+
+// Preconditioned conjugate gradients on the assembled matrix, A x = b starting from x
+unsigned int ImplicitSolver::conjugateGradient(vector<glm::dvec3>& x, const vector<glm::dvec3>& b)
+{
+    const size_t rows = hessian.rows();
+    inverseDiagonals.resize(rows);
+    preconditioned.resize(rows);
+    direction.resize(rows);
+    residual.resize(rows);
+
+    hessian.multiply(x, product);
+    pool.parallelFor(0, rows, [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; r++)
+        {
+            inverseDiagonals[r] = glm::inverse(hessian.diagonalBlock(r));
+            residual[r] = b[r] - product[r];
+            preconditioned[r] = inverseDiagonals[r] * residual[r];
+            direction[r] = preconditioned[r];
+        }
+    }, MIN_CHUNK);
+
+    const double target = tolerance * tolerance * dot(b, b);
+    double rho = dot(residual, preconditioned);
+    unsigned int iteration = 0;
+    while (iteration < maxIterations && dot(residual, residual) > target)
+    {
+        hessian.multiply(direction, product);
+        const double curvature = dot(direction, product);
+        if (curvature <= 0)
+            break;
+        const double alpha = rho / curvature;
+        pool.parallelFor(0, rows, [&](size_t begin, size_t end) {
+            for (size_t r = begin; r < end; r++)
+            {
+                x[r] += alpha * direction[r];
+                residual[r] -= alpha * product[r];
+                preconditioned[r] = inverseDiagonals[r] * residual[r];
+            }
+        }, MIN_CHUNK);
+
+        const double nextRho = dot(residual, preconditioned);
+        const double beta = nextRho / rho;
+        rho = nextRho;
+        pool.parallelFor(0, rows, [&](size_t begin, size_t end) {
+            for (size_t r = begin; r < end; r++)
+                direction[r] = preconditioned[r] + beta * direction[r];
+        }, MIN_CHUNK);
+        iteration++;
+    }
+    return iteration;
+}
+
+/*
+    Solves for the new velocities starting from the old ones changed as
+    much as they changed last step, then moves the particles by them. The
+    ground stops particles rather than bouncing them, like the other
+    solvers that take whole frames.
+*/
+void ImplicitSolver::step(vector<Particle>& particles, const vector<Spring>& springs, const SimulationParams& params)
+{
+    steps++;
+    if (newton.iterations > 0)
+    {
+        stepNewton(particles, springs, params);
+        return;
+    }
+
+    hessian.assemble(particles, springs, params.airDampening, params.deltaT);
+    gatherForces(particles, springs, params);
+
+    const size_t rows = hessian.rows();
+    if (lastVelocityChange.size() != rows)
+        lastVelocityChange.assign(rows, glm::dvec3(0));
+    velocities.resize(rows);
+    for (size_t r = 0; r < rows; r++)
+        velocities[r] = glm::dvec3(particles[hessian.particleOf(r)].velocity) + lastVelocityChange[r];
+    totalIterations += conjugateGradient(velocities, rhs);
+    solves++;
+
+    pool.parallelFor(0, rows, [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; r++)
+        {
+            Particle& particle = particles[hessian.particleOf(r)];
+            glm::vec3 velocity = glm::vec3(velocities[r]);
+            particle.position += velocity * params.deltaT;
+            if (params.ground && particle.position.y < params.groundHeight)
+            {
+                particle.position.y = params.groundHeight;
+                velocity.y = max(velocity.y, 0.0f);
+            }
+            lastVelocityChange[r] = glm::dvec3(velocity - particle.velocity);
+            particle.velocity = velocity;
+        }
+    }, MIN_CHUNK);
+    for (auto& particle : particles)
+        particle.netForce = glm::vec3(0);
+}
+
+glm::dvec3 ImplicitSolver::position(const vector<Particle>& particles, const vector<glm::dvec3>& rows, size_t particle) const
+{
+    size_t row = hessian.rowOf(particle);
+    return row != BlockHessian::STATIC ? rows[row] : glm::dvec3(particles[particle].position);
+}
+
+/*
+    The incremental potential at the positions in rows, scaled by deltaT^2
+    so its Hessian is the one BlockHessian assembles. Dampening is measured
+    along each spring's direction at the start of the step, which makes it a
+    quadratic in the positions.
+*/
+double ImplicitSolver::potential(const vector<Particle>& particles, const vector<Spring>& springs,
+                                 const SimulationParams& params, const vector<glm::dvec3>& rows) const
+{
+    const double h = params.deltaT;
+    double sum = 0;
+    for (size_t r = 0; r < rows.size(); r++)
+    {
+        const double mass = particles[hessian.particleOf(r)].mass;
+        glm::dvec3 fromInertial = rows[r] - inertial[r];
+        glm::dvec3 moved = rows[r] - start[r];
+        sum += 0.5 * mass * glm::dot(fromInertial, fromInertial) - h * h * mass * glm::dot(glm::dvec3(params.gravity), rows[r])
+             + 0.5 * h * params.airDampening * glm::dot(moved, moved);
+    }
+    for (size_t s = 0; s < springs.size(); s++)
+    {
+        const Spring& spring = springs[s];
+        glm::dvec3 difference = position(particles, rows, spring.p1) - position(particles, rows, spring.p2);
+        double stretch = glm::length(difference) - spring.restLength;
+        double stretched = glm::dot(startDirections[s], difference - startDifferences[s]);
+        sum += 0.5 * h * h * max((double)spring.stiffness, 0.0) * stretch * stretch
+             + 0.5 * h * max((double)spring.dampening, 0.0) * stretched * stretched;
+    }
+    return sum;
+}
+
+// potential's gradient at iterate, into gradient
+void ImplicitSolver::potentialGradient(const vector<Particle>& particles, const vector<Spring>& springs,
+                                       const SimulationParams& params)
+{
+    const double h = params.deltaT;
+    gradient.resize(iterate.size());
+    pool.parallelFor(0, iterate.size(), [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; r++)
+        {
+            const double mass = particles[hessian.particleOf(r)].mass;
+            gradient[r] = mass * (iterate[r] - inertial[r]) - (h * h * mass) * glm::dvec3(params.gravity)
+                        + (h * params.airDampening) * (iterate[r] - start[r]);
+        }
+    }, MIN_CHUNK);
+    for (size_t s = 0; s < springs.size(); s++)
+    {
+        const Spring& spring = springs[s];
+        glm::dvec3 difference = position(particles, iterate, spring.p1) - position(particles, iterate, spring.p2);
+        double length = glm::length(difference);
+        glm::dvec3 pull = glm::dvec3(0);
+        if (length > 0)
+            pull = difference * (h * h * max((double)spring.stiffness, 0.0) * (length - spring.restLength) / length);
+        pull += startDirections[s] * (h * max((double)spring.dampening, 0.0) *
+                                      glm::dot(startDirections[s], difference - startDifferences[s]));
+        size_t a = hessian.rowOf(spring.p1);
+        size_t b = hessian.rowOf(spring.p2);
+        if (a != BlockHessian::STATIC)
+            gradient[a] += pull;
+        if (b != BlockHessian::STATIC)
+            gradient[b] -= pull;
+    }
+}
+
+/*
+    Newton's method on the incremental potential. It starts from momentum
+    plus the last step's change in velocity, which on smooth motion is most
+    of the way there, unless momentum alone is lower. Each direction comes
+    from conjugate gradients to the usual relative tolerance, and is halved
+    until the potential drops by at least ARMIJO of what the gradient
+    predicts.
+*/
+void ImplicitSolver::stepNewton(vector<Particle>& particles, const vector<Spring>& springs, const SimulationParams& params)
+{
+    if (hessian.rows() == 0 || lastVelocityChange.size() != hessian.rows())
+        setScene(particles, springs, params);
+
+    const size_t rows = hessian.rows();
+    const double h = params.deltaT;
+    start.resize(rows);
+    inertial.resize(rows);
+    trial.resize(rows);
+    for (size_t r = 0; r < rows; r++)
+    {
+        const Particle& particle = particles[hessian.particleOf(r)];
+        start[r] = glm::dvec3(particle.position);
+        inertial[r] = start[r] + h * glm::dvec3(particle.velocity);
+        trial[r] = inertial[r] + h * lastVelocityChange[r];
+    }
+    startDifferences.resize(springs.size());
+    startDirections.resize(springs.size());
+    for (size_t s = 0; s < springs.size(); s++)
+    {
+        startDifferences[s] = glm::dvec3(particles[springs[s].p1].position - particles[springs[s].p2].position);
+        double length = glm::length(startDifferences[s]);
+        startDirections[s] = length > 0 ? startDifferences[s] / length : glm::dvec3(0);
+    }
+
+    iterate = inertial;
+    double energy = potential(particles, springs, params, iterate);
+    double warm = potential(particles, springs, params, trial);
+    if (warm < energy)
+    {
+        swap(iterate, trial);
+        energy = warm;
+    }
+
+    for (unsigned int iteration = 0; iteration < newton.iterations; iteration++)
+    {
+        for (size_t r = 0; r < rows; r++)
+            particles[hessian.particleOf(r)].position = glm::vec3(iterate[r]);
+        hessian.assemble(particles, springs, params.airDampening, params.deltaT);
+        potentialGradient(particles, springs, params);
+        rhs.resize(rows);
+        for (size_t r = 0; r < rows; r++)
+            rhs[r] = -gradient[r];
+        newtonStep.assign(rows, glm::dvec3(0));
+        totalIterations += conjugateGradient(newtonStep, rhs);
+        solves++;
+        newtonIterations++;
+
+        const double slope = dot(gradient, newtonStep);
+        if (!(slope < 0))
+            break;
+        double largest = 0;
+        for (const auto& change : newtonStep)
+            largest = max(largest, glm::length(change));
+
+        double alpha = 1;
+        double trialEnergy = energy;
+        bool decreased = false;
+        for (unsigned int halving = 0; halving <= newton.lineSearchSteps; halving++)
+        {
+            for (size_t r = 0; r < rows; r++)
+                trial[r] = iterate[r] + alpha * newtonStep[r];
+            trialEnergy = potential(particles, springs, params, trial);
+            if (trialEnergy <= energy + ARMIJO * alpha * slope)
+            {
+                decreased = true;
+                break;
+            }
+            alpha *= 0.5;
+            backtracks++;
+        }
+        if (!decreased)
+            break;
+        swap(iterate, trial);
+        energy = trialEnergy;
+        if (alpha * largest < newton.tolerance * h)
+            break;
+    }
+
+    pool.parallelFor(0, rows, [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; r++)
+        {
+            Particle& particle = particles[hessian.particleOf(r)];
+            glm::dvec3 velocity = (iterate[r] - start[r]) / h;
+            particle.position = glm::vec3(iterate[r]);
+            if (params.ground && particle.position.y < params.groundHeight)
+            {
+                particle.position.y = params.groundHeight;
+                velocity.y = max(velocity.y, 0.0);
+            }
+            lastVelocityChange[r] = velocity - glm::dvec3(particle.velocity);
+            particle.velocity = glm::vec3(velocity);
+        }
+    }, MIN_CHUNK);
+    for (auto& particle : particles)
+        particle.netForce = glm::vec3(0);
+}
@@ -0,0 +1,52 @@
+#include "MappedFile.h"
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const string& path, bool sequential)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        cerr << "Failed to open " << path << endl;
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size == 0)
+    {
+        cerr << path << " is empty" << endl;
+        ::close(fd);
+        return false;
+    }
+
+    void* mapped = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);        // the mapping keeps the file open
+    if (mapped == MAP_FAILED)
+    {
+        cerr << "Failed to map " << path << endl;
+        return false;
+    }
+    mapping = mapped;
+    length = status.st_size;
+    madvise(mapping, length, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mapping)
+        munmap(mapping, length);
+    mapping = nullptr;
+    length = 0;
+}
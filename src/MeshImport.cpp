@@ -0,0 +1,804 @@
+#include "MeshImport.h"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <unordered_map>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "MappedFile.h"
+#include "Quantize.h"
+
+using namespace std;
+
+namespace
+{
+    const unsigned int NONE = 0xFFFFFFFFu;
+    const size_t SHARDS = 64;
+
+    enum SpringType : unsigned int
+    {
+        Structural,
+        Shear,
+        Bending,
+        SPRING_TYPES,
+        TriangleSide = SPRING_TYPES     // not a spring, finds the triangles around an edge for bending
+    };
+
+    struct Mesh
+    {
+        vector<glm::vec3> vertices;
+        vector<unsigned int> faceOffsets = { 0 };   // face i is corners[faceOffsets[i]] to corners[faceOffsets[i+1] - 1]
+        vector<unsigned int> corners;
+        vector<glm::uvec4> tetrahedra;
+    };
+
+    size_t chunkCount(ThreadPool& threadPool)
+    {
+        return (threadPool.size() + 1) * 4;
+    }
+
+    unsigned long long mix(unsigned long long value)
+    {
+        // splitmix64 finalizer, spreads nearby particle indices across shards
+        value ^= value >> 30;
+        value *= 0xBF58476D1CE4E5B9ull;
+        value ^= value >> 27;
+        value *= 0x94D049BB133111EBull;
+        return value ^ (value >> 31);
+    }
+
+    size_t shardOf(unsigned long long hash)
+    {
+        return hash >> 58;          // top 6 bits, SHARDS is 64
+    }
+
+    /*
+        Text helpers. Files are mapped, not null terminated, so everything
+        works on [begin, end) ranges.
+    */
+
+    struct TextRange
+    {
+        const char* begin;
+        const char* end;
+    };
+
+    // about count ranges that each end after a line break
+    vector<TextRange> splitLines(const char* begin, const char* end, size_t count)
+    {
+        vector<TextRange> ranges;
+        const char* start = begin;
+        for (size_t i = 1; i <= count && start < end; i++)
+        {
+            const char* stop = i == count ? end : max(start, begin + (end - begin) * i / count);
+            stop = find(stop, end, '\n');
+            if (stop < end)
+                stop++;
+            ranges.push_back({ start, stop });
+            start = stop;
+        }
+        return ranges;
+    }
+
+    template <typename Parse>
+    void forEachLine(TextRange range, Parse parse)
+    {
+        const char* line = range.begin;
+        while (line < range.end)
+        {
+            const char* lineEnd = find(line, range.end, '\n');
+            parse(line, lineEnd);
+            line = lineEnd + 1;
+        }
+    }
+
+    const char* skipSpace(const char* p, const char* end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+            p++;
+        return p;
+    }
+
+    template <typename T>
+    bool parseNumber(const char*& p, const char* end, T& value)
+    {
+        p = skipSpace(p, end);
+        if (p < end && *p == '+')
+            p++;            // from_chars doesn't take a leading +
+        auto result = from_chars(p, end, value);
+        if (result.ec != errc())
+            return false;
+        p = result.ptr;
+        return true;
+    }
+
+    bool isBlankOrComment(const char* p, const char* end)
+    {
+        p = skipSpace(p, end);
+        return p == end || *p == '#';
+    }
+
+    /*
+        OBJ. Each chunk collects its own vertices and faces, then the chunks
+        are stitched together in order. Negative (relative) face indices are
+        counted from the chunk's first vertex and shifted once every chunk's
+        vertex count is known.
+    */
+
+    struct ObjChunk
+    {
+        vector<glm::vec3> vertices;
+        vector<unsigned int> faceSizes;
+        vector<long long> corners;
+        vector<size_t> relativeCorners;
+        size_t badLines = 0;
+    };
+
+    void parseObjChunk(TextRange range, ObjChunk& chunk)
+    {
+        vector<long long> face;
+        vector<bool> relative;
+        forEachLine(range, [&](const char* p, const char* end) {
+            p = skipSpace(p, end);
+            if (end - p < 2 || (p[1] != ' ' && p[1] != '\t'))
+                return;         // blank, a comment, or vt, vn, usemtl and the like
+
+            if (p[0] == 'v')
+            {
+                glm::vec3 vertex;
+                p++;
+                if (parseNumber(p, end, vertex.x) && parseNumber(p, end, vertex.y) && parseNumber(p, end, vertex.z))
+                    chunk.vertices.push_back(vertex);
+                else
+                    chunk.badLines++;
+            }
+            else if (p[0] == 'f')
+            {
+                face.clear();
+                relative.clear();
+                bool zeroIndex = false;
+                long long index;
+                p++;
+                while (parseNumber(p, end, index))
+                {
+                    zeroIndex = zeroIndex || index == 0;
+                    face.push_back(index > 0 ? index - 1 : (long long)chunk.vertices.size() + index);
+                    relative.push_back(index < 0);
+                    while (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+                        p++;        // texture and normal indices
+                }
+                if (face.size() < 3 || zeroIndex)
+                {
+                    chunk.badLines++;
+                    return;
+                }
+                for (size_t i = 0; i < face.size(); i++)
+                {
+                    if (relative[i])
+                        chunk.relativeCorners.push_back(chunk.corners.size());
+                    chunk.corners.push_back(face[i]);
+                }
+                chunk.faceSizes.push_back(face.size());
+            }
+        });
+    }
+
+    bool loadObj(const string& path, ThreadPool& threadPool, Mesh& mesh)
+    {
+        MappedFile file;
+        if (!file.open(path))
+            return false;
+
+        vector<TextRange> ranges = splitLines(file.data(), file.data() + file.size(), chunkCount(threadPool));
+        vector<ObjChunk> chunks(ranges.size());
+        threadPool.parallelFor(0, ranges.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                parseObjChunk(ranges[i], chunks[i]);
+        }, 1);
+
+        vector<size_t> vertexStarts(chunks.size() + 1, 0), faceStarts(chunks.size() + 1, 0), cornerStarts(chunks.size() + 1, 0);
+        size_t badLines = 0;
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            vertexStarts[i + 1] = vertexStarts[i] + chunks[i].vertices.size();
+            faceStarts[i + 1] = faceStarts[i] + chunks[i].faceSizes.size();
+            cornerStarts[i + 1] = cornerStarts[i] + chunks[i].corners.size();
+            badLines += chunks[i].badLines;
+        }
+
+        const long long vertexCount = vertexStarts.back();
+        mesh.vertices.resize(vertexCount);
+        mesh.faceOffsets.resize(faceStarts.back() + 1);
+        mesh.corners.resize(cornerStarts.back());
+        vector<char> outOfRange(chunks.size(), false);
+        threadPool.parallelFor(0, chunks.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                ObjChunk& chunk = chunks[i];
+                for (size_t corner : chunk.relativeCorners)
+                    chunk.corners[corner] += vertexStarts[i];
+                copy(chunk.vertices.begin(), chunk.vertices.end(), mesh.vertices.begin() + vertexStarts[i]);
+
+                unsigned int offset = cornerStarts[i];
+                for (size_t face = 0; face < chunk.faceSizes.size(); face++)
+                {
+                    offset += chunk.faceSizes[face];
+                    mesh.faceOffsets[faceStarts[i] + face + 1] = offset;
+                }
+                for (size_t corner = 0; corner < chunk.corners.size(); corner++)
+                {
+                    long long index = chunk.corners[corner];
+                    outOfRange[i] = outOfRange[i] || index < 0 || index >= vertexCount;
+                    mesh.corners[cornerStarts[i] + corner] = index;
+                }
+                chunk = ObjChunk();
+            }
+        }, 1);
+
+        if (find(outOfRange.begin(), outOfRange.end(), true) != outOfRange.end())
+        {
+            cerr << path << " has faces using vertices it doesn't have" << endl;
+            return false;
+        }
+        if (badLines > 0)
+            cerr << "Skipped " << badLines << " unreadable lines in " << path << endl;
+        return true;
+    }
+
+    /*
+        tetgen. The header gives the number of lines, and every line starts
+        with its own index, so chunks write straight into place.
+    */
+
+    // reads the numbers on the first line that isn't blank or a comment
+    bool readHeader(const char*& p, const char* end, long long values[], int count)
+    {
+        while (p < end)
+        {
+            const char* lineEnd = find(p, end, '\n');
+            if (!isBlankOrComment(p, lineEnd))
+            {
+                for (int i = 0; i < count; i++)
+                {
+                    if (!parseNumber(p, lineEnd, values[i]))
+                        values[i] = 0;      // trailing fields are optional
+                }
+                p = lineEnd < end ? lineEnd + 1 : end;
+                return true;
+            }
+            p = lineEnd < end ? lineEnd + 1 : end;
+        }
+        return false;
+    }
+
+    // the index on the first line after the header, tetgen numbers from 0 or 1
+    long long firstIndex(const char* p, const char* end)
+    {
+        TextRange rest = { p, end };
+        long long index = 0;
+        bool found = false;
+        forEachLine(rest, [&](const char* line, const char* lineEnd) {
+            if (!found && !isBlankOrComment(line, lineEnd))
+                found = parseNumber(line, lineEnd, index);
+        });
+        return index;
+    }
+
+    /*
+        Parses count lines of "index value..." after the header, calling
+        store(index - base, lineRest, lineEnd) for each. Returns false if any
+        index is out of range or lines are missing.
+    */
+    template <typename Store>
+    bool parseIndexedLines(const char* begin, const char* end, long long base, size_t count, ThreadPool& threadPool, Store store)
+    {
+        vector<TextRange> ranges = splitLines(begin, end, chunkCount(threadPool));
+        vector<size_t> parsed(ranges.size(), 0);
+        vector<char> failed(ranges.size(), false);
+        threadPool.parallelFor(0, ranges.size(), [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; i++)
+            {
+                forEachLine(ranges[i], [&](const char* p, const char* lineEnd) {
+                    if (isBlankOrComment(p, lineEnd))
+                        return;
+                    long long index;
+                    if (!parseNumber(p, lineEnd, index) || index - base < 0 || index - base >= (long long)count ||
+                        !store(index - base, p, lineEnd))
+                        failed[i] = true;
+                    else
+                        parsed[i]++;
+                });
+            }
+        }, 1);
+
+        size_t total = 0;
+        for (size_t i = 0; i < ranges.size(); i++)
+            total += parsed[i];
+        return total == count && find(failed.begin(), failed.end(), true) == failed.end();
+    }
+
+    bool loadTetgen(const string& path, ThreadPool& threadPool, Mesh& mesh)
+    {
+        string stem = path.substr(0, path.find_last_of('.'));
+        MappedFile nodeFile, elementFile;
+        if (!nodeFile.open(stem + ".node") || !elementFile.open(stem + ".ele"))
+            return false;
+
+        const char* p = nodeFile.data();
+        const char* end = p + nodeFile.size();
+        long long nodeHeader[4];            // points, dimensions, attributes, boundary markers
+        if (!readHeader(p, end, nodeHeader, 4) || nodeHeader[0] <= 0 || nodeHeader[1] != 3)
+        {
+            cerr << stem << ".node is not a 3D tetgen node file" << endl;
+            return false;
+        }
+        const long long base = firstIndex(p, end);
+        mesh.vertices.resize(nodeHeader[0]);
+        bool nodesRead = parseIndexedLines(p, end, base, mesh.vertices.size(), threadPool,
+            [&mesh](long long index, const char* q, const char* lineEnd) {
+                glm::vec3& vertex = mesh.vertices[index];
+                return parseNumber(q, lineEnd, vertex.x) && parseNumber(q, lineEnd, vertex.y) && parseNumber(q, lineEnd, vertex.z);
+            });
+        if (!nodesRead)
+        {
+            cerr << "Failed to read the nodes in " << stem << ".node" << endl;
+            return false;
+        }
+
+        p = elementFile.data();
+        end = p + elementFile.size();
+        long long elementHeader[3];         // tetrahedra, nodes per tetrahedron, region attribute
+        if (!readHeader(p, end, elementHeader, 3) || elementHeader[0] <= 0 || elementHeader[1] < 4)
+        {
+            cerr << stem << ".ele is not a tetgen element file" << endl;
+            return false;
+        }
+        const long long vertexCount = mesh.vertices.size();
+        mesh.tetrahedra.resize(elementHeader[0]);
+        // the second order nodes of 10 node tetrahedra are ignored
+        bool elementsRead = parseIndexedLines(p, end, firstIndex(p, end), mesh.tetrahedra.size(), threadPool,
+            [&mesh, base, vertexCount](long long index, const char* q, const char* lineEnd) {
+                for (int corner = 0; corner < 4; corner++)
+                {
+                    long long node;
+                    if (!parseNumber(q, lineEnd, node) || node - base < 0 || node - base >= vertexCount)
+                        return false;
+                    mesh.tetrahedra[index][corner] = node - base;
+                }
+                return true;
+            });
+        if (!elementsRead)
+        {
+            cerr << "Failed to read the tetrahedra in " << stem << ".ele" << endl;
+            return false;
+        }
+        return true;
+    }
+
+    /*
+        Sharded deduplication. produce(item, emit) is called for every item,
+        chunks of items in parallel, and each emitted entry lands in the
+        shard picked by entry.hash(). Shards come back in a deterministic
+        order, each one ready to be deduplicated without locks.
+    */
+    template <typename Entry, typename Produce>
+    vector< vector<Entry> > partition(ThreadPool& threadPool, size_t itemCount, Produce produce)
+    {
+        const size_t chunks = chunkCount(threadPool);
+        vector< vector< vector<Entry> > > local(chunks, vector< vector<Entry> >(SHARDS));
+        threadPool.parallelFor(0, chunks, [&](size_t begin, size_t end) {
+            for (size_t chunk = begin; chunk < end; chunk++)
+            {
+                auto emit = [&local, chunk](const Entry& entry) { local[chunk][shardOf(entry.hash())].push_back(entry); };
+                for (size_t item = itemCount * chunk / chunks; item < itemCount * (chunk + 1) / chunks; item++)
+                    produce(item, emit);
+            }
+        }, 1);
+
+        vector< vector<Entry> > shards(SHARDS);
+        threadPool.parallelFor(0, SHARDS, [&](size_t begin, size_t end) {
+            for (size_t shard = begin; shard < end; shard++)
+            {
+                size_t size = 0;
+                for (size_t chunk = 0; chunk < chunks; chunk++)
+                    size += local[chunk][shard].size();
+                shards[shard].reserve(size);
+                for (size_t chunk = 0; chunk < chunks; chunk++)
+                {
+                    shards[shard].insert(shards[shard].end(), local[chunk][shard].begin(), local[chunk][shard].end());
+                    vector<Entry>().swap(local[chunk][shard]);
+                }
+            }
+        }, 1);
+        return shards;
+    }
+
+    unsigned long long edgeKey(unsigned int a, unsigned int b)
+    {
+        if (a > b)
+            swap(a, b);
+        return (unsigned long long)a << 32 | b;
+    }
+
+    struct EdgeEntry
+    {
+        unsigned long long key;         // from edgeKey
+        unsigned int type;
+        unsigned int opposite;          // for TriangleSide, the triangle's third corner
+
+        unsigned long long hash() const { return mix(key); }
+    };
+
+    // a tetrahedron face and the corner it doesn't touch
+    struct FaceEntry
+    {
+        unsigned int sorted[3];         // identifies the face
+        unsigned int corners[3];        // wound to face away from opposite
+        unsigned int opposite;
+
+        unsigned long long hash() const { return mix(mix(sorted[0]) ^ ((unsigned long long)sorted[1] << 32 | sorted[2])); }
+    };
+
+    struct FaceKeyHash
+    {
+        size_t operator()(const array<unsigned int, 3>& key) const
+        {
+            return mix(mix(key[0]) ^ ((unsigned long long)key[1] << 32 | key[2]));
+        }
+    };
+
+    // the springs in one shard, sorted by key within each type
+    struct ShardSprings
+    {
+        vector<unsigned long long> keys[SPRING_TYPES];
+        vector<unsigned long long> bendingCandidates;
+        size_t boundaryStructural = 0;      // volumes only, keys[Structural] starts with this many boundary edges
+    };
+
+    void addBendingSprings(ThreadPool& threadPool, vector<ShardSprings>& shards)
+    {
+        // bending candidates were found in the shard of the edge they cross,
+        // send them to the shard of their own key to deduplicate
+        vector<size_t> starts(shards.size() + 1, 0);
+        for (size_t shard = 0; shard < shards.size(); shard++)
+            starts[shard + 1] = starts[shard] + shards[shard].bendingCandidates.size();
+        vector<unsigned long long> candidates(starts.back());
+        for (size_t shard = 0; shard < shards.size(); shard++)
+        {
+            copy(shards[shard].bendingCandidates.begin(), shards[shard].bendingCandidates.end(), candidates.begin() + starts[shard]);
+            vector<unsigned long long>().swap(shards[shard].bendingCandidates);
+        }
+
+        auto bending = partition<EdgeEntry>(threadPool, candidates.size(), [&](size_t i, auto& emit) {
+            emit(EdgeEntry{ candidates[i], Bending, NONE });
+        });
+
+        threadPool.parallelFor(0, SHARDS, [&](size_t begin, size_t end) {
+            for (size_t shard = begin; shard < end; shard++)
+            {
+                vector<unsigned long long>& keys = shards[shard].keys[Bending];
+                for (const auto& entry : bending[shard])
+                    keys.push_back(entry.key);
+                sort(keys.begin(), keys.end());
+                keys.erase(unique(keys.begin(), keys.end()), keys.end());
+
+                // a structural or shear spring already holds these two together
+                auto existing = [&](unsigned long long key) {
+                    for (unsigned int type : { Structural, Shear })
+                    {
+                        const auto& typeKeys = shards[shard].keys[type];
+                        if (binary_search(typeKeys.begin(), typeKeys.end(), key))
+                            return true;
+                    }
+                    return false;
+                };
+                keys.erase(remove_if(keys.begin(), keys.end(), existing), keys.end());
+            }
+        }, 1);
+    }
+
+    vector<ShardSprings> buildEdges(ThreadPool& threadPool, const vector< vector<EdgeEntry> >& edgeShards)
+    {
+        vector<ShardSprings> shards(SHARDS);
+        threadPool.parallelFor(0, SHARDS, [&](size_t begin, size_t end) {
+            struct EdgeInfo
+            {
+                unsigned int type = NONE;
+                unsigned int opposite = NONE;
+            };
+            for (size_t shard = begin; shard < end; shard++)
+            {
+                unordered_map<unsigned long long, EdgeInfo> edges;
+                edges.reserve(edgeShards[shard].size());
+                for (const auto& entry : edgeShards[shard])
+                {
+                    EdgeInfo& info = edges[entry.key];
+                    if (entry.type != TriangleSide)
+                        info.type = min(info.type, entry.type);
+                    else if (info.opposite == NONE)
+                        info.opposite = entry.opposite;
+                    else if (info.opposite != entry.opposite)
+                        shards[shard].bendingCandidates.push_back(edgeKey(info.opposite, entry.opposite));
+                }
+                for (const auto& edge : edges)
+                {
+                    if (edge.second.type != NONE)
+                        shards[shard].keys[edge.second.type].push_back(edge.first);
+                }
+                for (auto& keys : shards[shard].keys)
+                    sort(keys.begin(), keys.end());
+            }
+        }, 1);
+        return shards;
+    }
+
+    vector<ShardSprings> surfaceSprings(const Mesh& mesh, ThreadPool& threadPool, vector<unsigned int>& triangles)
+    {
+        const size_t faceCount = mesh.faceOffsets.size() - 1;
+        auto edgeShards = partition<EdgeEntry>(threadPool, faceCount, [&](size_t face, auto& emit) {
+            const unsigned int* c = &mesh.corners[mesh.faceOffsets[face]];
+            const unsigned int n = mesh.faceOffsets[face + 1] - mesh.faceOffsets[face];
+            for (unsigned int i = 0; i < n; i++)
+            {
+                for (unsigned int j = i + 1; j < n; j++)
+                {
+                    if (c[i] == c[j])
+                        continue;
+                    bool side = j == i + 1 || (i == 0 && j == n - 1);
+                    emit(EdgeEntry{ edgeKey(c[i], c[j]), side ? Structural : Shear, NONE });
+                }
+            }
+            // fan triangles
+            for (unsigned int i = 1; i + 1 < n; i++)
+            {
+                unsigned int t[3] = { c[0], c[i], c[i + 1] };
+                for (unsigned int k = 0; k < 3; k++)
+                    emit(EdgeEntry{ edgeKey(t[k], t[(k + 1) % 3]), TriangleSide, t[(k + 2) % 3] });
+            }
+        });
+        vector<ShardSprings> shards = buildEdges(threadPool, edgeShards);
+        edgeShards.clear();
+        addBendingSprings(threadPool, shards);
+
+        triangles.resize((mesh.corners.size() - 2 * faceCount) * 3);
+        threadPool.parallelFor(0, faceCount, [&](size_t begin, size_t end) {
+            for (size_t face = begin; face < end; face++)
+            {
+                const unsigned int* c = &mesh.corners[mesh.faceOffsets[face]];
+                const unsigned int n = mesh.faceOffsets[face + 1] - mesh.faceOffsets[face];
+                unsigned int* out = &triangles[(mesh.faceOffsets[face] - 2 * face) * 3];
+                for (unsigned int i = 1; i + 1 < n; i++, out += 3)
+                {
+                    out[0] = c[0];
+                    out[1] = c[i];
+                    out[2] = c[i + 1];
+                }
+            }
+        });
+        return shards;
+    }
+
+    vector<ShardSprings> volumeSprings(const Mesh& mesh, ThreadPool& threadPool, vector<unsigned int>& triangles)
+    {
+        auto edgeShards = partition<EdgeEntry>(threadPool, mesh.tetrahedra.size(), [&](size_t tet, auto& emit) {
+            const glm::uvec4& t = mesh.tetrahedra[tet];
+            for (int i = 0; i < 4; i++)
+            {
+                for (int j = i + 1; j < 4; j++)
+                {
+                    if (t[i] != t[j])
+                        emit(EdgeEntry{ edgeKey(t[i], t[j]), Structural, NONE });
+                }
+            }
+        });
+        vector<ShardSprings> shards = buildEdges(threadPool, edgeShards);
+        edgeShards.clear();
+
+        auto faceShards = partition<FaceEntry>(threadPool, mesh.tetrahedra.size(), [&](size_t tet, auto& emit) {
+            const glm::uvec4& t = mesh.tetrahedra[tet];
+            for (int skip = 0; skip < 4; skip++)
+            {
+                FaceEntry face;
+                for (int i = 0, k = 0; i < 4; i++)
+                {
+                    if (i != skip)
+                        face.corners[k++] = t[i];
+                }
+                face.opposite = t[skip];
+                const glm::vec3& a = mesh.vertices[face.corners[0]];
+                glm::vec3 normal = glm::cross(mesh.vertices[face.corners[1]] - a, mesh.vertices[face.corners[2]] - a);
+                if (glm::dot(normal, a - mesh.vertices[face.opposite]) < 0)
+                    swap(face.corners[1], face.corners[2]);
+                copy(face.corners, face.corners + 3, face.sorted);
+                sort(face.sorted, face.sorted + 3);
+                emit(face);
+            }
+        });
+
+        // faces seen once are on the boundary, faces seen twice join two tetrahedra
+        vector< vector<unsigned int> > shardTriangles(SHARDS);
+        threadPool.parallelFor(0, SHARDS, [&](size_t begin, size_t end) {
+            for (size_t shard = begin; shard < end; shard++)
+            {
+                unordered_map<array<unsigned int, 3>, pair<unsigned int, size_t>, FaceKeyHash> faces;   // first opposite, count
+                faces.reserve(faceShards[shard].size());
+                for (const auto& face : faceShards[shard])
+                {
+                    auto inserted = faces.emplace(array<unsigned int, 3>{ face.sorted[0], face.sorted[1], face.sorted[2] },
+                                                  make_pair(face.opposite, (size_t)0));
+                    auto& seen = inserted.first->second;
+                    if (seen.second++ == 1 && seen.first != face.opposite)
+                        shards[shard].bendingCandidates.push_back(edgeKey(seen.first, face.opposite));
+                }
+                for (const auto& face : faceShards[shard])
+                {
+                    if (faces[{ face.sorted[0], face.sorted[1], face.sorted[2] }].second == 1)
+                        shardTriangles[shard].insert(shardTriangles[shard].end(), face.corners, face.corners + 3);
+                }
+                vector<FaceEntry>().swap(faceShards[shard]);
+            }
+        }, 1);
+        addBendingSprings(threadPool, shards);
+
+        // the edges of the boundary faces go first among each shard's structural springs
+        auto boundaryShards = partition<EdgeEntry>(threadPool, SHARDS, [&](size_t faceShard, auto& emit) {
+            const vector<unsigned int>& t = shardTriangles[faceShard];
+            for (size_t i = 0; i < t.size(); i += 3)
+            {
+                for (int k = 0; k < 3; k++)
+                    emit(EdgeEntry{ edgeKey(t[i + k], t[i + (k + 1) % 3]), Structural, NONE });
+            }
+        });
+        threadPool.parallelFor(0, SHARDS, [&](size_t begin, size_t end) {
+            for (size_t shard = begin; shard < end; shard++)
+            {
+                vector<unsigned long long> boundary;
+                boundary.reserve(boundaryShards[shard].size());
+                for (const auto& entry : boundaryShards[shard])
+                    boundary.push_back(entry.key);
+                sort(boundary.begin(), boundary.end());
+                boundary.erase(unique(boundary.begin(), boundary.end()), boundary.end());
+
+                vector<unsigned long long>& keys = shards[shard].keys[Structural];
+                auto interior = stable_partition(keys.begin(), keys.end(), [&boundary](unsigned long long key) {
+                    return binary_search(boundary.begin(), boundary.end(), key);
+                });
+                shards[shard].boundaryStructural = interior - keys.begin();
+                vector<EdgeEntry>().swap(boundaryShards[shard]);
+            }
+        }, 1);
+
+        for (const auto& shardFaces : shardTriangles)
+            triangles.insert(triangles.end(), shardFaces.begin(), shardFaces.end());
+        return shards;
+    }
+}
+
+bool MeshImport::canLoad(const string& path)
+{
+    size_t dot = path.find_last_of('.');
+    string extension = dot == string::npos ? "" : path.substr(dot);
+    return extension == ".obj" || extension == ".node" || extension == ".ele";
+}
+
+bool MeshImport::load(const string& path, const ImportOptions& options, ThreadPool& threadPool, SceneData& scene)
+{
+    auto start = chrono::steady_clock::now();
+
+    Mesh mesh;
+    const bool surface = path.substr(path.find_last_of('.')) == ".obj";
+    if (!(surface ? loadObj(path, threadPool, mesh) : loadTetgen(path, threadPool, mesh)))
+        return false;
+    if (mesh.vertices.size() >= NONE)
+    {
+        cerr << path << " has too many vertices" << endl;
+        return false;
+    }
+    if (mesh.vertices.empty())
+    {
+        cerr << path << " has no vertices" << endl;
+        return false;
+    }
+
+    // fit the mesh to the same space the built in scenes use
+    Bounds bounds = computeBounds(&mesh.vertices[0].x, mesh.vertices.size() * 3);
+    glm::vec3 extent = bounds.max - bounds.min;
+    float longest = max(max(extent.x, extent.y), extent.z);
+    const float scale = longest > 0 ? options.size / longest : 1;
+    const glm::vec3 middle = (bounds.min + bounds.max) * 0.5f;
+    for (auto& vertex : mesh.vertices)
+        vertex = options.centre + (vertex - middle) * scale;
+
+    scene = SceneData();
+    vector<ShardSprings> shards = surface ? surfaceSprings(mesh, threadPool, scene.surfaceTriangles)
+                                          : volumeSprings(mesh, threadPool, scene.surfaceTriangles);
+
+    Particle particle;
+    particle.mass = options.particleMass;
+    particle.weight = 1 / particle.mass;
+    particle.velocity = glm::vec3(0);
+    particle.netForce = glm::vec3(0);
+    scene.particles.resize(mesh.vertices.size(), particle);
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+        scene.particles[i].position = mesh.vertices[i];
+
+    // structural springs first, then shear, then bending, so each level of
+    // detail draws a prefix of the lines. A volume's structural springs on
+    // the boundary come before the interior ones.
+    struct Run
+    {
+        unsigned int type;
+        size_t shard, begin, end;       // of shards[shard].keys[type]
+    };
+    vector<Run> runs;
+    for (unsigned int type = 0; type < SPRING_TYPES; type++)
+    {
+        const bool split = !surface && type == Structural;
+        for (size_t shard = 0; shard < SHARDS; shard++)
+            runs.push_back({ type, shard, 0, split ? shards[shard].boundaryStructural : shards[shard].keys[type].size() });
+        for (size_t shard = 0; split && shard < SHARDS; shard++)
+            runs.push_back({ type, shard, shards[shard].boundaryStructural, shards[shard].keys[type].size() });
+    }
+    vector<size_t> starts(runs.size() + 1, 0);
+    for (size_t run = 0; run < runs.size(); run++)
+        starts[run + 1] = starts[run] + runs[run].end - runs[run].begin;
+    auto linesBefore = [&](unsigned int type) {
+        size_t run = 0;
+        while (run < runs.size() && runs[run].type < type)
+            run++;
+        return starts[run] * 2;
+    };
+
+    const float stiffness[SPRING_TYPES] = { options.structuralStiffness, options.shearStiffness, options.bendingStiffness };
+    scene.springs.resize(starts.back());
+    scene.lineIndices.resize(starts.back() * 2);
+    threadPool.parallelFor(0, runs.size(), [&](size_t begin, size_t end) {
+        for (size_t run = begin; run < end; run++)
+        {
+            const Run& keys = runs[run];
+            Spring spring;
+            spring.stiffness = stiffness[keys.type];
+            spring.dampening = options.dampingRatio * 2 * sqrt(options.particleMass * spring.stiffness);
+
+            size_t out = starts[run];
+            for (size_t i = keys.begin; i < keys.end; i++)
+            {
+                const unsigned long long key = shards[keys.shard].keys[keys.type][i];
+                spring.p1 = key >> 32;
+                spring.p2 = key & 0xFFFFFFFFu;
+                spring.restLength = glm::distance(mesh.vertices[spring.p1], mesh.vertices[spring.p2]);
+                scene.springs[out] = spring;
+                scene.lineIndices[out * 2] = spring.p1;
+                scene.lineIndices[out * 2 + 1] = spring.p2;
+                out++;
+            }
+        }
+    }, 1);
+
+    // all, surface, structural and decimated levels, see Engine::LodLevel. A
+    // volume's surface is the edges of its boundary faces. Tetrahedra have
+    // no grid lines to keep, so its structural and decimated levels are
+    // the surface level too.
+    const unsigned int structuralLines = linesBefore(Shear);
+    if (surface)
+        scene.lodIndexCounts = { (unsigned int)scene.lineIndices.size(), (unsigned int)linesBefore(Bending), structuralLines, structuralLines };
+    else
+    {
+        const unsigned int boundaryLines = starts[SHARDS] * 2;
+        scene.lodIndexCounts = { (unsigned int)scene.lineIndices.size(), boundaryLines, boundaryLines, boundaryLines };
+    }
+
+    scene.colliders.push_back({ options.centre.y - options.size, options.size * 2 });
+    scene.camera.view = glm::lookAt(glm::vec3(0, 1, 16), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0));
+    scene.camera.projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
+    scene.camera.particleRadius = 0.12f;
+
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Imported " << path << ": " << scene.particles.size() << " particles, " << scene.springs.size()
+         << " springs (" << linesBefore(Shear) / 2 << " structural, " << (linesBefore(Bending) - linesBefore(Shear)) / 2 << " shear, "
+         << starts.back() - linesBefore(Bending) / 2 << " bending) in " << ms << " ms" << endl;
+    return true;
+}
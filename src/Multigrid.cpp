@@ -0,0 +1,327 @@
+#include "Multigrid.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+    const size_t MIN_CHUNK = 256;
+
+    /*
+        Along an axis of length size, coarse node c sits on fine node 2c. An
+        even length also keeps its last fine node, one past the last even
+        one, so the coarse nodes always reach both ends of the axis.
+    */
+    unsigned int coarsen(unsigned int size)
+    {
+        return size > 2 ? (size + 1) / 2 + (size % 2 == 0) : size;
+    }
+
+    unsigned int fineUnder(unsigned int coarse, unsigned int size)
+    {
+        return size > 2 ? min(2 * coarse, size - 1) : coarse;
+    }
+
+    // A node's neighbours one level down along an axis of length size, with their weights
+    unsigned int coarseNeighbours(unsigned int node, unsigned int size, unsigned int coarse[2], double weights[2])
+    {
+        if (size <= 2)
+        {
+            coarse[0] = node;
+            weights[0] = 1;
+            return 1;
+        }
+        if (node % 2 == 0 || node == size - 1)
+        {
+            coarse[0] = (node + 1) / 2;
+            weights[0] = 1;
+            return 1;
+        }
+        coarse[0] = node / 2;
+        coarse[1] = node / 2 + 1;
+        weights[0] = weights[1] = 0.5;
+        return 2;
+    }
+}
+
+bool Multigrid::build(const ParticleGrid& grid, const vector<size_t>& rows, size_t size,
+                      const vector<SparseCholesky::Entry>& entries, const MultigridOptions& options, ThreadPool& pool)
+{
+    this->options = options;
+    this->pool = &pool;
+    levels.clear();
+    levels.emplace_back();
+    levels[0].A = fromEntries(size, entries);
+
+    glm::uvec3 fineSize = grid.size;
+    vector<size_t> fineRows = rows;
+    while (levels.back().A.rows() > options.coarsestSize &&
+           (options.maxLevels == 0 || levels.size() < options.maxLevels))
+    {
+        glm::uvec3 coarseSize(coarsen(fineSize.x), coarsen(fineSize.y), coarsen(fineSize.z));
+        if (coarseSize == fineSize)
+            break;
+
+        // a coarse node is kept if the fine node under it is an unknown
+        auto fineNode = [&](glm::uvec3 node) { return ((size_t)node.x * fineSize.y + node.y) * fineSize.z + node.z; };
+        vector<size_t> coarseRows((size_t)coarseSize.x * coarseSize.y * coarseSize.z, STATIC);
+        size_t coarseCount = 0;
+        for (unsigned int x = 0; x < coarseSize.x; x++)
+        {
+            for (unsigned int y = 0; y < coarseSize.y; y++)
+            {
+                for (unsigned int z = 0; z < coarseSize.z; z++)
+                {
+                    glm::uvec3 under(fineUnder(x, fineSize.x), fineUnder(y, fineSize.y), fineUnder(z, fineSize.z));
+                    if (fineRows[fineNode(under)] != STATIC)
+                        coarseRows[((size_t)x * coarseSize.y + y) * coarseSize.z + z] = coarseCount++;
+                }
+            }
+        }
+
+        // interpolation, the product of each axis's weights, leaving out coarse nodes that aren't kept
+        Level& fine = levels.back();
+        fine.P.rowStarts.assign(fine.A.rows() + 1, 0);
+        vector<vector<pair<size_t, double>>> interpolation(fine.A.rows());
+        for (unsigned int x = 0; x < fineSize.x; x++)
+        {
+            for (unsigned int y = 0; y < fineSize.y; y++)
+            {
+                for (unsigned int z = 0; z < fineSize.z; z++)
+                {
+                    size_t row = fineRows[fineNode(glm::uvec3(x, y, z))];
+                    if (row == STATIC)
+                        continue;
+                    unsigned int cx[2], cy[2], cz[2];
+                    double wx[2], wy[2], wz[2];
+                    unsigned int nx = coarseNeighbours(x, fineSize.x, cx, wx);
+                    unsigned int ny = coarseNeighbours(y, fineSize.y, cy, wy);
+                    unsigned int nz = coarseNeighbours(z, fineSize.z, cz, wz);
+                    for (unsigned int n = 0; n < nx * ny * nz; n++)
+                    {
+                        unsigned int i = n / (ny * nz), j = (n / nz) % ny, k = n % nz;
+                        size_t column = coarseRows[((size_t)cx[i] * coarseSize.y + cy[j]) * coarseSize.z + cz[k]];
+                        if (column != STATIC)
+                            interpolation[row].push_back({ column, wx[i] * wy[j] * wz[k] });
+                    }
+                }
+            }
+        }
+        for (size_t row = 0; row < interpolation.size(); row++)
+        {
+            fine.P.rowStarts[row + 1] = fine.P.rowStarts[row] + interpolation[row].size();
+            for (const auto& weight : interpolation[row])
+            {
+                fine.P.columns.push_back(weight.first);
+                fine.P.values.push_back(weight.second);
+            }
+        }
+        fine.R = transpose(fine.P, coarseCount);
+
+        Level coarse;
+        coarse.A = multiply(fine.R, multiply(fine.A, fine.P, coarseCount), coarseCount);
+        levels.push_back(move(coarse));
+        fineSize = coarseSize;
+        fineRows = move(coarseRows);
+    }
+
+    for (auto& level : levels)
+    {
+        const size_t count = level.A.rows();
+        level.inverseDiagonal.assign(count, 0);
+        for (size_t row = 0; row < count; row++)
+        {
+            for (size_t i = level.A.rowStarts[row]; i < level.A.rowStarts[row + 1]; i++)
+            {
+                if (level.A.columns[i] == row)
+                    level.inverseDiagonal[row] = 1 / level.A.values[i];
+            }
+        }
+        level.x.resize(count);
+        level.b.resize(count);
+        level.residual.resize(count);
+    }
+
+    const Matrix& last = levels.back().A;
+    vector<SparseCholesky::Entry> coarsestEntries;
+    for (size_t row = 0; row < last.rows(); row++)
+    {
+        for (size_t i = last.rowStarts[row]; i < last.rowStarts[row + 1]; i++)
+        {
+            if (last.columns[i] <= row)
+                coarsestEntries.push_back({ row, last.columns[i], last.values[i] });
+        }
+    }
+    return coarsest.factor(last.rows(), coarsestEntries);
+}
+
+void Multigrid::solve(vector<glm::dvec3>& x, const vector<glm::dvec3>& b)
+{
+    Level& finest = levels[0];
+    swap(finest.x, x);
+    finest.b = b;
+    for (unsigned int i = 0; i < options.cycles; i++)
+        cycle(0);
+    swap(finest.x, x);
+}
+
+void Multigrid::cycle(size_t index)
+{
+    Level& level = levels[index];
+    if (index + 1 == levels.size())
+    {
+        level.x = level.b;
+        coarsest.solve(level.x);
+        return;
+    }
+
+    for (unsigned int i = 0; i < options.smoothing; i++)
+        smooth(level);
+
+    // what smoothing can't reach, solved for one level down
+    Level& coarse = levels[index + 1];
+    multiply(level.A, level.x, level.residual);
+    pool->parallelFor(0, level.residual.size(), [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; row++)
+            level.residual[row] = level.b[row] - level.residual[row];
+    }, MIN_CHUNK);
+    multiply(level.R, level.residual, coarse.b);
+    fill(coarse.x.begin(), coarse.x.end(), glm::dvec3(0));
+    cycle(index + 1);
+    multiply(level.P, coarse.x, level.residual);
+    pool->parallelFor(0, level.x.size(), [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; row++)
+            level.x[row] += level.residual[row];
+    }, MIN_CHUNK);
+
+    for (unsigned int i = 0; i < options.smoothing; i++)
+        smooth(level);
+}
+
+// One weighted Jacobi sweep, x += w D^-1 (b - A x)
+void Multigrid::smooth(Level& level) const
+{
+    multiply(level.A, level.x, level.residual);
+    pool->parallelFor(0, level.x.size(), [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; row++)
+            level.x[row] += (options.jacobiWeight * level.inverseDiagonal[row]) * (level.b[row] - level.residual[row]);
+    }, MIN_CHUNK);
+}
+
+void Multigrid::multiply(const Matrix& matrix, const vector<glm::dvec3>& x, vector<glm::dvec3>& result) const
+{
+    result.resize(matrix.rows());
+    pool->parallelFor(0, matrix.rows(), [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; row++)
+        {
+            glm::dvec3 sum(0);
+            for (size_t i = matrix.rowStarts[row]; i < matrix.rowStarts[row + 1]; i++)
+                sum += matrix.values[i] * x[matrix.columns[i]];
+            result[row] = sum;
+        }
+    }, MIN_CHUNK);
+}
+
+// Both triangles from the lower one, adding up repeats
+Multigrid::Matrix Multigrid::fromEntries(size_t size, const vector<SparseCholesky::Entry>& entries)
+{
+    Matrix lower;
+    lower.rowStarts.assign(size + 1, 0);
+    for (const auto& entry : entries)
+    {
+        if (entry.column > entry.row)
+            continue;
+        lower.rowStarts[entry.row + 1]++;
+        if (entry.column != entry.row)
+            lower.rowStarts[entry.column + 1]++;
+    }
+    for (size_t row = 0; row < size; row++)
+        lower.rowStarts[row + 1] += lower.rowStarts[row];
+    lower.columns.resize(lower.rowStarts[size]);
+    lower.values.resize(lower.rowStarts[size]);
+    vector<size_t> next(lower.rowStarts.begin(), lower.rowStarts.end() - 1);
+    for (const auto& entry : entries)
+    {
+        if (entry.column > entry.row)
+            continue;
+        lower.columns[next[entry.row]] = entry.column;
+        lower.values[next[entry.row]++] = entry.value;
+        if (entry.column != entry.row)
+        {
+            lower.columns[next[entry.column]] = entry.row;
+            lower.values[next[entry.column]++] = entry.value;
+        }
+    }
+
+    // multiplying by the identity sorts each row and merges the repeats
+    Matrix identity;
+    identity.rowStarts.resize(size + 1);
+    identity.columns.resize(size);
+    identity.values.assign(size, 1);
+    for (size_t row = 0; row <= size; row++)
+        identity.rowStarts[row] = row;
+    for (size_t row = 0; row < size; row++)
+        identity.columns[row] = row;
+    return multiply(lower, identity, size);
+}
+
+Multigrid::Matrix Multigrid::transpose(const Matrix& matrix, size_t columns)
+{
+    Matrix result;
+    result.rowStarts.assign(columns + 1, 0);
+    for (size_t column : matrix.columns)
+        result.rowStarts[column + 1]++;
+    for (size_t row = 0; row < columns; row++)
+        result.rowStarts[row + 1] += result.rowStarts[row];
+    result.columns.resize(matrix.columns.size());
+    result.values.resize(matrix.values.size());
+    vector<size_t> next(result.rowStarts.begin(), result.rowStarts.end() - 1);
+    for (size_t row = 0; row < matrix.rows(); row++)
+    {
+        for (size_t i = matrix.rowStarts[row]; i < matrix.rowStarts[row + 1]; i++)
+        {
+            size_t position = next[matrix.columns[i]]++;
+            result.columns[position] = row;
+            result.values[position] = matrix.values[i];
+        }
+    }
+    return result;
+}
+
+// A row at a time, accumulating into a dense row that's cleared through the columns it touched
+Multigrid::Matrix Multigrid::multiply(const Matrix& a, const Matrix& b, size_t columns)
+{
+    Matrix result;
+    result.rowStarts.assign(a.rows() + 1, 0);
+    vector<double> accumulator(columns, 0);
+    vector<bool> used(columns, false);
+    vector<size_t> touched;
+    for (size_t row = 0; row < a.rows(); row++)
+    {
+        touched.clear();
+        for (size_t i = a.rowStarts[row]; i < a.rowStarts[row + 1]; i++)
+        {
+            size_t middle = a.columns[i];
+            for (size_t j = b.rowStarts[middle]; j < b.rowStarts[middle + 1]; j++)
+            {
+                size_t column = b.columns[j];
+                if (!used[column])
+                {
+                    used[column] = true;
+                    touched.push_back(column);
+                }
+                accumulator[column] += a.values[i] * b.values[j];
+            }
+        }
+        sort(touched.begin(), touched.end());
+        for (size_t column : touched)
+        {
+            result.columns.push_back(column);
+            result.values.push_back(accumulator[column]);
+            accumulator[column] = 0;
+            used[column] = false;
+        }
+        result.rowStarts[row + 1] = result.columns.size();
+    }
+    return result;
+}
@@ -0,0 +1,397 @@
+#include "ProjectiveSolver.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+ProjectiveSolver::ProjectiveSolver(unsigned int iterations, ThreadPool& pool, GlobalStep globalStep,
+                                   const MultigridOptions& multigridOptions, double tolerance)
+: iterations(max(iterations, 1u)), pool(pool), requestedStep(globalStep), globalStep(globalStep),
+  multigridOptions(multigridOptions), tolerance(tolerance)
+{
+}
+
+bool ProjectiveSolver::parseGlobalStep(const string& name, GlobalStep& globalStep)
+{
+    if (name == "cholesky")
+        globalStep = Cholesky;
+    else if (name == "jacobi")
+        globalStep = Jacobi;
+    else if (name == "chebyshev")
+        globalStep = Chebyshev;
+    else if (name == "multigrid")
+        globalStep = Multigrid;
+    else
+        return false;
+    return true;
+}
+
+void ProjectiveSolver::setScene(const vector<Particle>& particles, const vector<Spring>& springs,
+                                const SimulationParams& params)
+{
+    unknowns.assign(particles.size(), STATIC);
+    particleIndices.clear();
+    for (size_t i = 0; i < particles.size(); i++)
+    {
+        if (particles[i].mass > 0)
+        {
+            unknowns[i] = particleIndices.size();
+            particleIndices.push_back(i);
+        }
+    }
+
+    // each row's springs, so the right hand side can be gathered a row at a time
+    const size_t rows = particleIndices.size();
+    incidenceStarts.assign(rows + 1, 0);
+    for (const auto& spring : springs)
+    {
+        for (size_t end : { spring.p1, spring.p2 })
+        {
+            if (unknowns[end] != STATIC)
+                incidenceStarts[unknowns[end] + 1]++;
+        }
+    }
+    for (size_t r = 0; r < rows; r++)
+        incidenceStarts[r + 1] += incidenceStarts[r];
+    incidences.resize(incidenceStarts[rows]);
+    vector<size_t> next(incidenceStarts.begin(), incidenceStarts.end() - 1);
+    for (size_t s = 0; s < springs.size(); s++)
+    {
+        if (unknowns[springs[s].p1] != STATIC)
+            incidences[next[unknowns[springs[s].p1]]++] = { (unsigned int)s, 1 };
+        if (unknowns[springs[s].p2] != STATIC)
+            incidences[next[unknowns[springs[s].p2]]++] = { (unsigned int)s, -1 };
+    }
+
+    lastCorrection.assign(particles.size(), glm::vec3(0));
+    factor(particles, springs, params.deltaT);
+}
+
+bool ProjectiveSolver::factor(const vector<Particle>& particles, const vector<Spring>& springs, float deltaT)
+{
+    auto start = chrono::steady_clock::now();
+    vector<SparseCholesky::Entry> entries;
+    const double inverseStepSquared = 1.0 / ((double)deltaT * deltaT);
+    diagonal.resize(particleIndices.size());
+    for (size_t r = 0; r < particleIndices.size(); r++)
+    {
+        diagonal[r] = particles[particleIndices[r]].mass * inverseStepSquared;
+        entries.push_back({ r, r, diagonal[r] });
+    }
+    for (const auto& spring : springs)
+    {
+        if (spring.stiffness <= 0)
+            continue;
+        size_t a = unknowns[spring.p1];
+        size_t b = unknowns[spring.p2];
+        if (a != STATIC)
+        {
+            entries.push_back({ a, a, spring.stiffness });
+            diagonal[a] += spring.stiffness;
+        }
+        if (b != STATIC)
+        {
+            entries.push_back({ b, b, spring.stiffness });
+            diagonal[b] += spring.stiffness;
+        }
+        if (a != STATIC && b != STATIC)
+            entries.push_back({ max(a, b), min(a, b), -spring.stiffness });
+    }
+
+    globalStep = requestedStep;
+    if (globalStep == Multigrid && grid.nodes() != particles.size())
+    {
+        cerr << "Multigrid needs a grid scene, solving with Cholesky instead" << endl;
+        globalStep = Cholesky;
+    }
+
+    // every diagonal is positive, so the sweeps always work
+    factored = true;
+    if (globalStep == Multigrid)
+        factored = multigrid.build(grid, unknowns, particleIndices.size(), entries, multigridOptions, pool);
+    else if (globalStep == Cholesky)
+        factored = cholesky.factor(particleIndices.size(), entries);
+    else if (globalStep == Chebyshev)
+        estimateSpectralRadius(springs);
+    factoredDeltaT = deltaT;
+    factorSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (!factored)
+        cerr << "Projective dynamics matrix isn't positive definite, nothing will move" << endl;
+    return factored;
+}
+
+/*
+    Power iteration on the Jacobi iteration matrix D^-1 (D - A). It's similar
+    to the symmetric D^-1/2 (D - A) D^-1/2, so measured in the norm weighted
+    by D each estimate is at most the radius and rises towards it, which is
+    the safe side.
+*/
+void ProjectiveSolver::estimateSpectralRadius(const vector<Spring>& springs)
+{
+    const size_t rows = particleIndices.size();
+    vector<double> estimate(rows, 1), product(rows);
+    spectralRadius = 0;
+    for (unsigned int iteration = 0; iteration < POWER_ITERATIONS && rows > 0; iteration++)
+    {
+        pool.parallelFor(0, rows, [&](size_t begin, size_t end) {
+            for (size_t r = begin; r < end; r++)
+            {
+                double sum = 0;
+                for (size_t i = incidenceStarts[r]; i < incidenceStarts[r + 1]; i++)
+                {
+                    const Spring& spring = springs[incidences[i].spring];
+                    size_t other = unknowns[incidences[i].sign > 0 ? spring.p2 : spring.p1];
+                    if (spring.stiffness > 0 && other != STATIC)
+                        sum += spring.stiffness * estimate[other];
+                }
+                product[r] = sum / diagonal[r];
+            }
+        }, MIN_CHUNK);
+
+        double length = 0, productLength = 0;
+        for (size_t r = 0; r < rows; r++)
+        {
+            length += diagonal[r] * estimate[r] * estimate[r];
+            productLength += diagonal[r] * product[r] * product[r];
+        }
+        if (productLength == 0)
+            break;
+        spectralRadius = sqrt(productLength / length);
+        const double scale = 1 / sqrt(productLength);
+        for (size_t r = 0; r < rows; r++)
+            estimate[r] = product[r] * scale;
+    }
+    spectralRadius *= RADIUS_SAFETY;
+}
+
+void ProjectiveSolver::reset()
+{
+    fill(lastCorrection.begin(), lastCorrection.end(), glm::vec3(0));
+}
+
+string ProjectiveSolver::describe() const
+{
+    ostringstream text;
+    text << "Projective dynamics with " << iterations << " iterations, " << particleIndices.size() << " unknowns, ";
+    if (globalStep == Cholesky)
+        text << cholesky.getStoredEntries() << " factor entries in " << factorSeconds * 1000 << " ms";
+    else if (globalStep == Jacobi)
+        text << "Jacobi global steps";
+    else if (globalStep == Multigrid)
+        text << multigrid.getLevelCount() << " multigrid levels down to " << multigrid.getCoarsestSize()
+             << " unknowns, " << multigridOptions.cycles << " V-cycles of " << multigridOptions.smoothing
+             << " sweeps, built in " << factorSeconds * 1000 << " ms";
+    else
+        text << "Chebyshev accelerated Jacobi global steps, spectral radius " << spectralRadius;
+    if (tolerance > 0)
+        text << ", stopping at a relative residual of " << tolerance;
+    return text.str();
+}
+
+string ProjectiveSolver::statistics() const
+{
+    if (steps == 0)
+        return string();
+    ostringstream text;
+    text << "Projective dynamics took " << (double)iterationsRun / steps << " iterations per step over " << steps << " steps";
+    return text.str();
+}
+
+/*
+    Fills solution with the global step's right hand side, or with
+    jacobi, with one Jacobi sweep from the current positions.
+*/
+void ProjectiveSolver::gather(const vector<Particle>& particles, const vector<Spring>& springs, float deltaT, bool jacobi)
+{
+    const double inverseStepSquared = 1.0 / ((double)deltaT * deltaT);
+    pool.parallelFor(0, particleIndices.size(), [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; r++)
+        {
+            const size_t p = particleIndices[r];
+            glm::dvec3 sum = glm::dvec3(inertial[p]) * (particles[p].mass * inverseStepSquared);
+            for (size_t i = incidenceStarts[r]; i < incidenceStarts[r + 1]; i++)
+            {
+                const Spring& spring = springs[incidences[i].spring];
+                if (spring.stiffness <= 0)
+                    continue;
+                sum += glm::dvec3(projections[incidences[i].spring]) * (double)(incidences[i].sign * spring.stiffness);
+                // a static neighbour is always known, a moving one only to a sweep
+                size_t other = incidences[i].sign > 0 ? spring.p2 : spring.p1;
+                if (jacobi || unknowns[other] == STATIC)
+                    sum += glm::dvec3(particles[other].position) * (double)spring.stiffness;
+            }
+            solution[r] = jacobi ? sum / diagonal[r] : sum;
+        }
+    }, MIN_CHUNK);
+}
+
+// The local step: the closest each spring can be to its current direction at rest length
+void ProjectiveSolver::project(const vector<Particle>& particles, const vector<Spring>& springs)
+{
+    pool.parallelFor(0, springs.size(), [&](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; s++)
+        {
+            const Spring& spring = springs[s];
+            glm::vec3 difference = particles[spring.p1].position - particles[spring.p2].position;
+            float distance = glm::length(difference);
+            projections[s] = distance > 0 ? difference * (spring.restLength / distance) : difference;
+        }
+    }, MIN_CHUNK);
+}
+
+/*
+    |b - A x| for the right hand side gather left in solution and the
+    particles' current positions. A's off-diagonal entries are minus the
+    stiffnesses of springs between two unknowns.
+*/
+double ProjectiveSolver::residualNorm(const vector<Particle>& particles, const vector<Spring>& springs)
+{
+    pool.parallelFor(0, particleIndices.size(), [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; r++)
+        {
+            glm::dvec3 product = glm::dvec3(particles[particleIndices[r]].position) * diagonal[r];
+            for (size_t i = incidenceStarts[r]; i < incidenceStarts[r + 1]; i++)
+            {
+                const Spring& spring = springs[incidences[i].spring];
+                size_t other = incidences[i].sign > 0 ? spring.p2 : spring.p1;
+                if (spring.stiffness > 0 && unknowns[other] != STATIC)
+                    product -= glm::dvec3(particles[other].position) * (double)spring.stiffness;
+            }
+            glm::dvec3 difference = solution[r] - product;
+            residuals[r] = glm::dot(difference, difference);
+        }
+    }, MIN_CHUNK);
+
+    double sum = 0;
+    for (double residual : residuals)
+        sum += residual;
+    return sqrt(sum);
+}
+
+/*
+    The ground is kept after each global step by moving particles back up
+    to it, so they land on it rather than bouncing. Spring dampening isn't
+    used, implicit Euler damps on its own.
+*/
+void ProjectiveSolver::step(vector<Particle>& particles, const vector<Spring>& springs, const SimulationParams& params)
+{
+    const float deltaT = params.deltaT;
+    if (unknowns.size() != particles.size())
+        setScene(particles, springs, params);
+    else if (deltaT != factoredDeltaT)
+        factor(particles, springs, deltaT);
+    if (!factored)
+        return;
+
+    previous.resize(particles.size());
+    inertial.resize(particles.size());
+    lastCorrection.resize(particles.size());
+    pool.parallelFor(0, particles.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            Particle& particle = particles[i];
+            previous[i] = particle.position;
+            inertial[i] = particle.position;
+            if (particle.mass <= 0)
+                continue;
+            glm::vec3 force = particle.mass * params.gravity - params.airDampening * particle.velocity;
+            inertial[i] += (particle.velocity + force * particle.weight * deltaT) * deltaT;
+            particle.position = inertial[i];
+        }
+    }, MIN_CHUNK);
+
+    projections.resize(springs.size());
+    solution.resize(particleIndices.size());
+    older.resize(particleIndices.size());
+    residuals.resize(particleIndices.size());
+
+    // residuals are relative to the one at momentum alone, so a better start doesn't make them stricter
+    double initialResidual = 0;
+    if (tolerance > 0)
+    {
+        project(particles, springs);
+        gather(particles, springs, deltaT, false);
+        initialResidual = residualNorm(particles, springs);
+    }
+    if (tolerance == 0 || initialResidual > 0)
+    {
+        pool.parallelFor(0, particles.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                if (particles[i].mass > 0)
+                    particles[i].position = inertial[i] + lastCorrection[i] * deltaT;
+            }
+        }, MIN_CHUNK);
+    }
+
+    double omega = 1;
+    steps++;
+    for (unsigned int iteration = 0; iteration < iterations; iteration++)
+    {
+        project(particles, springs);
+
+        // the right hand side depends on the projections, so the residual can only be checked after them
+        bool gathered = false;
+        if (tolerance > 0)
+        {
+            gather(particles, springs, deltaT, false);
+            gathered = true;
+            if (residualNorm(particles, springs) <= tolerance * initialResidual)
+                break;
+        }
+        iterationsRun++;
+
+        if (globalStep == Cholesky)
+        {
+            if (!gathered)
+                gather(particles, springs, deltaT, false);
+            cholesky.solve(solution);
+        }
+        else if (globalStep == Multigrid)
+        {
+            // from where the last iteration left the particles, so later iterations start close
+            if (!gathered)
+                gather(particles, springs, deltaT, false);
+            guess.resize(particleIndices.size());
+            for (size_t r = 0; r < particleIndices.size(); r++)
+                guess[r] = glm::dvec3(particles[particleIndices[r]].position);
+            multigrid.solve(guess, solution);
+            swap(guess, solution);
+        }
+        else
+            gather(particles, springs, deltaT, true);
+
+        // the usual Chebyshev weights, 1 and then approaching a limit set by the radius
+        if (globalStep == Chebyshev)
+        {
+            const double radiusSquared = spectralRadius * spectralRadius;
+            omega = iteration == 0 ? 1 : iteration == 1 ? 2 / (2 - radiusSquared) : 4 / (4 - radiusSquared * omega);
+        }
+        pool.parallelFor(0, particleIndices.size(), [&](size_t begin, size_t end) {
+            for (size_t r = begin; r < end; r++)
+            {
+                glm::vec3& position = particles[particleIndices[r]].position;
+                glm::vec3 current = position;
+                position = glm::vec3(solution[r]);
+                if (omega != 1)
+                    position = glm::vec3(omega * (solution[r] - glm::dvec3(older[r])) + glm::dvec3(older[r]));
+                if (params.ground && position.y < params.groundHeight)
+                    position.y = params.groundHeight;
+                older[r] = current;
+            }
+        }, MIN_CHUNK);
+    }
+
+    for (size_t i = 0; i < particles.size(); i++)
+    {
+        Particle& particle = particles[i];
+        if (particle.mass > 0)
+        {
+            particle.velocity = (particle.position - previous[i]) / deltaT;
+            lastCorrection[i] = (particle.position - inertial[i]) / deltaT;
+        }
+        particle.netForce = glm::vec3(0);
+    }
+}
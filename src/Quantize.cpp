@@ -0,0 +1,54 @@
+#include "Quantize.h"
+#include <algorithm>
+
+Bounds computeBounds(const float positions[], size_t size)
+{
+    Bounds bounds;
+    bounds.min = glm::vec3(0);
+    bounds.max = glm::vec3(0);
+    if (size < 3)
+        return bounds;
+
+    // keep each axis in its own accumulator so the loop stays branch free
+    // and the compiler can vectorize it
+    float minX = positions[0], minY = positions[1], minZ = positions[2];
+    float maxX = minX, maxY = minY, maxZ = minZ;
+    for (size_t i = 3; i + 2 < size; i += 3)
+    {
+        minX = std::min(minX, positions[i]);
+        minY = std::min(minY, positions[i + 1]);
+        minZ = std::min(minZ, positions[i + 2]);
+        maxX = std::max(maxX, positions[i]);
+        maxY = std::max(maxY, positions[i + 1]);
+        maxZ = std::max(maxZ, positions[i + 2]);
+    }
+
+    bounds.min = glm::vec3(minX, minY, minZ);
+    bounds.max = glm::vec3(maxX, maxY, maxZ);
+    return bounds;
+}
+
+void quantizePositions(const float positions[], size_t size, const Bounds& bounds, unsigned short out[])
+{
+    const glm::vec3 extent = bounds.max - bounds.min;
+    float scale[3], offset[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        // a flat axis (eg. every particle at x = 0) maps everything to 0
+        scale[axis] = extent[axis] > 0 ? 65535.0f / extent[axis] : 0.0f;
+        offset[axis] = bounds.min[axis];
+    }
+
+    for (size_t i = 0; i + 2 < size; i += 3)
+    {
+        // + 0.5 rounds to nearest since the values are never negative
+        out[i]     = (unsigned short)((positions[i]     - offset[0]) * scale[0] + 0.5f);
+        out[i + 1] = (unsigned short)((positions[i + 1] - offset[1]) * scale[1] + 0.5f);
+        out[i + 2] = (unsigned short)((positions[i + 2] - offset[2]) * scale[2] + 0.5f);
+    }
+}
+
+glm::vec3 dequantizeScale(const Bounds& bounds)
+{
+    return bounds.max - bounds.min;
+}
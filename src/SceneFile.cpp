@@ -0,0 +1,200 @@
+#include "SceneFile.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "MappedFile.h"
+
+using namespace std;
+
+namespace
+{
+    struct SectionSource
+    {
+        SceneFile::SectionType type;
+        uint32_t elementSize;
+        const void* data;
+        uint64_t count;
+    };
+
+    template <typename T>
+    SectionSource section(SceneFile::SectionType type, const vector<T>& elements)
+    {
+        return { type, sizeof(T), elements.data(), elements.size() };
+    }
+
+    uint64_t alignUp(uint64_t offset)
+    {
+        return (offset + 15) & ~uint64_t(15);
+    }
+
+    // copies a section out of the mapping, checking it fits the file and the struct
+    template <typename T>
+    bool readSection(const SceneFile::Section& entry, const unsigned char* file, size_t fileSize, vector<T>& out)
+    {
+        if (entry.elementSize != sizeof(T))
+        {
+            cerr << "Scene section " << entry.type << " has " << entry.elementSize << " byte elements, expected " << sizeof(T) << endl;
+            return false;
+        }
+        if (entry.offset > fileSize || entry.count > (fileSize - entry.offset) / sizeof(T))
+        {
+            cerr << "Scene section " << entry.type << " runs past the end of the file" << endl;
+            return false;
+        }
+        out.resize(entry.count);
+        if (entry.count > 0)
+            memcpy(out.data(), file + entry.offset, entry.count * sizeof(T));
+        return true;
+    }
+}
+
+bool SceneFile::save(const string& path, const SceneData& scene)
+{
+    vector<SceneCamera> camera = { scene.camera };
+    vector<SimulationState> simulation = { { scene.simulationTime } };
+    vector<SectionSource> sources = {
+        section(Particles, scene.particles),
+        section(Springs, scene.springs),
+        section(LineIndices, scene.lineIndices),
+        section(LodIndexCounts, scene.lodIndexCounts),
+        section(SurfaceTriangles, scene.surfaceTriangles),
+        section(Pins, scene.pins),
+        section(Colliders, scene.colliders),
+        section(Camera, camera),
+        section(Simulation, simulation)
+    };
+
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.sectionCount = sources.size();
+
+    vector<Section> table(sources.size());
+    uint64_t offset = alignUp(sizeof(Header) + sizeof(Section) * table.size());
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        table[i] = { sources[i].type, sources[i].elementSize, offset, sources[i].count };
+        offset = alignUp(offset + sources[i].elementSize * sources[i].count);
+    }
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        cerr << "Failed to open " << path << " for writing" << endl;
+        return false;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(table.data(), sizeof(Section), table.size(), file) == table.size();
+    for (size_t i = 0; i < sources.size() && written; i++)
+    {
+        // pad up to the aligned start of the section
+        static const char zeros[16] = {};
+        long position = ftell(file);
+        written = fwrite(zeros, 1, table[i].offset - position, file) == table[i].offset - position;
+        if (written && sources[i].count > 0)
+            written = fwrite(sources[i].data, sources[i].elementSize, sources[i].count, file) == sources[i].count;
+    }
+    written = fclose(file) == 0 && written;
+
+    if (!written)
+        cerr << "Failed to write " << path << endl;
+    return written;
+}
+
+bool SceneFile::load(const string& path, SceneData& scene)
+{
+    auto start = chrono::steady_clock::now();
+
+    MappedFile mapping;
+    if (!mapping.open(path))
+        return false;
+    if (mapping.size() < sizeof(Header))
+    {
+        cerr << path << " is not a scene file" << endl;
+        return false;
+    }
+    const size_t fileSize = mapping.size();
+
+    const unsigned char* file = (const unsigned char*)mapping.data();
+    const Header* header = (const Header*)file;
+    bool loaded = true;
+    if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0)
+    {
+        cerr << path << " is not a scene file" << endl;
+        loaded = false;
+    }
+    else if (header->version != VERSION)
+    {
+        cerr << path << " is scene version " << header->version << ", expected " << VERSION << endl;
+        loaded = false;
+    }
+    else if (header->sectionCount > (fileSize - sizeof(Header)) / sizeof(Section))
+    {
+        cerr << path << " is truncated" << endl;
+        loaded = false;
+    }
+
+    scene = SceneData();
+    scene.camera = { glm::mat4(1.0f), glm::mat4(1.0f), 0.02f };
+    const Section* table = (const Section*)(file + sizeof(Header));
+    for (uint32_t i = 0; loaded && i < header->sectionCount; i++)
+    {
+        const Section& entry = table[i];
+        switch (entry.type)
+        {
+            case Particles : loaded = readSection(entry, file, fileSize, scene.particles); break;
+            case Springs : loaded = readSection(entry, file, fileSize, scene.springs); break;
+            case LineIndices : loaded = readSection(entry, file, fileSize, scene.lineIndices); break;
+            case LodIndexCounts : loaded = readSection(entry, file, fileSize, scene.lodIndexCounts); break;
+            case SurfaceTriangles : loaded = readSection(entry, file, fileSize, scene.surfaceTriangles); break;
+            case Pins : loaded = readSection(entry, file, fileSize, scene.pins); break;
+            case Colliders : loaded = readSection(entry, file, fileSize, scene.colliders); break;
+            case Camera :
+            {
+                vector<SceneCamera> camera;
+                loaded = readSection(entry, file, fileSize, camera);
+                if (loaded && !camera.empty())
+                    scene.camera = camera[0];
+                break;
+            }
+            case Simulation :
+            {
+                vector<SimulationState> simulation;
+                loaded = readSection(entry, file, fileSize, simulation);
+                if (loaded && !simulation.empty())
+                    scene.simulationTime = simulation[0].time;
+                break;
+            }
+            default : break;        // from a newer writer, not needed here
+        }
+    }
+    mapping.close();
+    if (!loaded)
+        return false;
+
+    // indices are checked once here so the simulation never has to
+    const size_t particleCount = scene.particles.size();
+    bool indicesValid = true;
+    for (const auto& spring : scene.springs)
+        indicesValid = indicesValid && spring.p1 < particleCount && spring.p2 < particleCount;
+    for (const auto* indices : { &scene.lineIndices, &scene.surfaceTriangles, &scene.pins })
+    {
+        for (unsigned int index : *indices)
+            indicesValid = indicesValid && index < particleCount;
+    }
+    if (!indicesValid)
+    {
+        cerr << path << " refers to particles it doesn't have" << endl;
+        return false;
+    }
+
+    for (unsigned int pin : scene.pins)
+        scene.particles[pin].mass = 0;
+
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Loaded " << path << ": " << particleCount << " particles, " << scene.springs.size()
+         << " springs in " << ms << " ms" << endl;
+    return true;
+}
@@ -1,5 +1,6 @@
 #include <glad/glad.h>
 #include "Shader.h"
+#include "GLState.h"
 
 #include <string>
 #include <iostream>
@@ -24,6 +25,8 @@ Shader::~Shader()
 	{
 		glDeleteShader(shader);
 	}
+	if (ID)
+		GLState::deleteProgram(ID);
 }
 
 bool Shader::addShader(string shaderPath, GLenum type)
@@ -95,37 +98,54 @@ string Shader::parseShader(string path)
 
 void Shader::use() const
 {
-	glUseProgram(ID);
+	GLState::useProgram(ID);
 }
 
 void Shader::unuse() const
 {
-	glUseProgram(0);
+	// left in use on purpose, the next use() of another program replaces it
 }
 
-void Shader::setUniform1i(const char *uniform, int value)
+GLint Shader::getUniformLocation(const char *uniform)
 {
+	auto found = uniformLocations.find(uniform);
+	if (found != uniformLocations.end())
+		return found->second;
+
 	GLint uniformLocation = glGetUniformLocation(ID, uniform);
+	GLState::countCalls();
+	uniformLocations.emplace(uniform, uniformLocation);
+	return uniformLocation;
+}
+
+void Shader::setUniform1i(const char *uniform, int value)
+{
+	GLint uniformLocation = getUniformLocation(uniform);
+	GLState::countCalls();
 	glUniform1i(uniformLocation, value);
 }
 void Shader::setUniform1f(const char *uniform, float value)
 {
-	GLint uniformLocation = glGetUniformLocation(ID, uniform);
+	GLint uniformLocation = getUniformLocation(uniform);
+	GLState::countCalls();
 	glUniform1f(uniformLocation, value);
 }
 void Shader::setUniformMatrix4fv(const char *uniform, const glm::mat4 &matrix)
 {
-	GLint uniformLocation = glGetUniformLocation(ID, uniform);
+	GLint uniformLocation = getUniformLocation(uniform);
+	GLState::countCalls();
 	glUniformMatrix4fv(uniformLocation, 1, GL_FALSE, glm::value_ptr(matrix));
 }
 void Shader::setUniform3fv(const char *uniform, const glm::vec3 &vec)
 {
-	GLint uniformLocation = glGetUniformLocation(ID, uniform);
+	GLint uniformLocation = getUniformLocation(uniform);
+	GLState::countCalls();
 	glUniform3fv(uniformLocation, 1, glm::value_ptr(vec));
 }
 void Shader::setUniform4fv(const char *uniform, const glm::vec4 &vec)
 {
-	GLint uniformLocation = glGetUniformLocation(ID, uniform);
+	GLint uniformLocation = getUniformLocation(uniform);
+	GLState::countCalls();
 	glUniform4fv(uniformLocation, 1, glm::value_ptr(vec));
 }
 GLuint Shader::getID() const { return ID; }
\ No newline at end of file
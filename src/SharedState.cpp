@@ -0,0 +1,205 @@
+#include "SharedState.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    size_t alignTo64(size_t size)
+    {
+        return (size + 63) & ~(size_t)63;
+    }
+}
+
+string SharedState::objectName(const string& name)
+{
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+SharedStatePublisher::~SharedStatePublisher()
+{
+    close();
+}
+
+bool SharedStatePublisher::open(const string& objectName, size_t particleCount)
+{
+    close();
+    name = SharedState::objectName(objectName);
+
+    // a fresh object rather than reusing a stale one, readers still mapping that keep it alive
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        cerr << "Failed to create shared memory " << name << ": " << strerror(errno) << endl;
+        return false;
+    }
+
+    size_t slotsOffset = alignTo64(sizeof(SharedState::Header));
+    size_t slotSize = alignTo64(sizeof(SharedState::SlotHeader) + particleCount * 3 * sizeof(float));
+    size_t size = slotsOffset + SharedState::SLOTS * slotSize;
+    void* mapped = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+        mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        cerr << "Failed to map shared memory " << name << ": " << strerror(errno) << endl;
+        shm_unlink(name.c_str());
+        return false;
+    }
+    mapping = mapped;
+    length = size;
+
+    // the object starts zeroed, so the counters are already 0
+    header = (SharedState::Header*)mapping;
+    header->particleCount = particleCount;
+    header->slotCount = SharedState::SLOTS;
+    header->slotsOffset = slotsOffset;
+    header->slotSize = slotSize;
+    atomic_thread_fence(memory_order_release);
+    memcpy(header->magic, SharedState::MAGIC, sizeof(header->magic));
+    return true;
+}
+
+void SharedStatePublisher::publish(const vector<Particle>& particles, double time)
+{
+    if (!header)
+        return;
+
+    uint64_t snapshot = header->published.load(memory_order_relaxed);
+    char* slotStart = (char*)mapping + header->slotsOffset + (snapshot % header->slotCount) * header->slotSize;
+    auto slot = (SharedState::SlotHeader*)slotStart;
+    float* positions = (float*)(slotStart + sizeof(SharedState::SlotHeader));
+
+    uint64_t sequence = slot->sequence.load(memory_order_relaxed);
+    slot->sequence.store(sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);         // odd before any of the data changes
+
+    slot->snapshot = snapshot;
+    slot->time = time;
+    const size_t count = min<size_t>(particles.size(), header->particleCount);
+    for (size_t i = 0; i < count; i++)
+    {
+        positions[i*3] = particles[i].position.x;
+        positions[i*3 + 1] = particles[i].position.y;
+        positions[i*3 + 2] = particles[i].position.z;
+    }
+
+    slot->sequence.store(sequence + 2, memory_order_release);
+    header->published.store(snapshot + 1, memory_order_release);
+}
+
+void SharedStatePublisher::close()
+{
+    if (!mapping)
+        return;
+    header->closed.store(1, memory_order_release);
+    munmap(mapping, length);
+    shm_unlink(name.c_str());
+    mapping = nullptr;
+    header = nullptr;
+    length = 0;
+}
+
+SharedStateReader::~SharedStateReader()
+{
+    detach();
+}
+
+bool SharedStateReader::attach(const string& objectName)
+{
+    detach();
+    string name = SharedState::objectName(objectName);
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        if (errno != ENOENT)
+            cerr << "Failed to open shared memory " << name << ": " << strerror(errno) << endl;
+        return false;
+    }
+    struct stat status;
+    void* mapped = MAP_FAILED;
+    if (fstat(fd, &status) == 0 && (size_t)status.st_size >= sizeof(SharedState::Header))
+        mapped = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+        return false;           // created but not sized yet
+
+    auto mappedHeader = (const SharedState::Header*)mapped;
+    if (memcmp(mappedHeader->magic, SharedState::MAGIC, sizeof(mappedHeader->magic)) != 0)
+    {
+        munmap(mapped, status.st_size);
+        return false;           // not filled in yet, or not ours
+    }
+    atomic_thread_fence(memory_order_acquire);
+    if (mappedHeader->slotCount == 0 ||
+        mappedHeader->slotsOffset + mappedHeader->slotCount * mappedHeader->slotSize > (size_t)status.st_size ||
+        sizeof(SharedState::SlotHeader) + mappedHeader->particleCount * 3 * sizeof(float) > mappedHeader->slotSize)
+    {
+        cerr << "Shared memory " << name << " has a bad header" << endl;
+        munmap(mapped, status.st_size);
+        return false;
+    }
+
+    mapping = mapped;
+    length = status.st_size;
+    header = mappedHeader;
+    lastPublished = 0;
+    return true;
+}
+
+void SharedStateReader::detach()
+{
+    if (mapping)
+        munmap(mapping, length);
+    mapping = nullptr;
+    header = nullptr;
+    length = 0;
+}
+
+bool SharedStateReader::isClosed() const
+{
+    return header && header->closed.load(memory_order_acquire) != 0;
+}
+
+bool SharedStateReader::read(float positions[], double& time)
+{
+    if (!header)
+        return false;
+
+    const size_t floatCount = header->particleCount * 3;
+    uint64_t published = header->published.load(memory_order_acquire);
+    for (uint32_t attempt = 0; attempt < header->slotCount; attempt++)
+    {
+        if (published == 0 || published == lastPublished)
+            return false;
+
+        uint64_t newest = published - 1;
+        const char* slotStart = (const char*)mapping + header->slotsOffset + (newest % header->slotCount) * header->slotSize;
+        auto slot = (const SharedState::SlotHeader*)slotStart;
+
+        uint64_t before = slot->sequence.load(memory_order_acquire);
+        if (!(before & 1))
+        {
+            uint64_t snapshot = slot->snapshot;
+            double snapshotTime = slot->time;
+            memcpy(positions, slotStart + sizeof(SharedState::SlotHeader), floatCount * sizeof(float));
+            atomic_thread_fence(memory_order_acquire);     // the copy finishes before the counter is checked again
+            if (slot->sequence.load(memory_order_relaxed) == before && snapshot >= newest)
+            {
+                time = snapshotTime;
+                lastPublished = snapshot + 1;
+                return true;
+            }
+        }
+        published = header->published.load(memory_order_acquire);
+    }
+    return false;
+}
@@ -0,0 +1,205 @@
+#include "Solver.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+void ExplicitSolver::step(vector<Particle>& particles, const vector<Spring>& springs, const SimulationParams& params)
+{
+    // calc spring force on each particle
+    for (const auto& spring : springs)
+    {
+        glm::vec3 force = springForce(spring, particles);
+        particles[spring.p1].netForce += force;
+        particles[spring.p2].netForce -= force;
+    }
+
+    // calc external forces on each particle then update position
+    for (auto& particle : particles)
+    {
+        particle.netForce += particle.mass * params.gravity;
+        particle.netForce += -params.airDampening * particle.velocity;
+
+        if (particle.mass > 0)      // if not a static particle
+        {
+            particle.velocity += (particle.netForce * particle.weight * params.deltaT);
+            particle.position += particle.velocity * params.deltaT;
+
+            if (params.ground && particle.position[1] <= params.groundHeight)
+            {
+                particle.position[1] = params.groundHeight + EPSILON;
+                particle.velocity = -particle.velocity;
+            }
+        }
+
+        particle.netForce = glm::vec3(0, 0, 0);
+    }
+}
+
+glm::vec3 ExplicitSolver::springForce(const Spring& spring, const vector<Particle>& particles)
+{
+    const Particle& p1 = particles[spring.p1];
+    const Particle& p2 = particles[spring.p2];
+
+    glm::vec3 forceDirection = p1.position - p2.position;
+    float distance = glm::distance(p1.position, p2.position);
+
+    forceDirection = glm::normalize(forceDirection);
+    // incase forceDirection is 0, then return
+    if ( abs(forceDirection[0]) >= 0.0 && abs(forceDirection[0]) < EPSILON &&
+        abs(forceDirection[1]) >= 0.0 && abs(forceDirection[1]) < EPSILON &&
+        abs(forceDirection[2]) >= 0.0 && abs(forceDirection[2]) < EPSILON )
+    {
+        return glm::vec3(0, 0, 0);
+    }
+
+    glm::vec3 hooksForce =  forceDirection * (-spring.stiffness * ( distance - spring.restLength));
+    // incase hooksForce is 0, then return
+    if ( abs(hooksForce[0]) >= 0.0 && abs(hooksForce[0]) < EPSILON &&
+        abs(hooksForce[1]) >= 0.0 && abs(hooksForce[1]) < EPSILON &&
+        abs(hooksForce[2]) >= 0.0 && abs(hooksForce[2]) < EPSILON )
+    {
+        return glm::vec3(0, 0, 0);
+    }
+
+    glm::vec3 hooksForceNorm = glm::normalize(hooksForce);
+    glm::vec3 dampeningForce = hooksForceNorm * -spring.dampening * ( (p1.velocity - p2.velocity) * hooksForce );
+
+    return hooksForce + dampeningForce;
+}
+
+/*
+    Each particle is an oscillator x'' = -w^2 x - g x', which symplectic Euler
+    keeps bounded while w^2 dt^2 + 2 g dt < 4. The highest w^2 of the whole
+    system is at most the largest Gershgorin row sum of M^-1/2 K M^-1/2,
+    where a spring's 3x3 block has norm at most its stiffness. Static
+    particles have infinite mass, so their terms drop out.
+*/
+float ExplicitSolver::stableTimestep(const vector<Particle>& particles, const vector<Spring>& springs,
+                                     const SimulationParams& params)
+{
+    vector<double> rowSums(particles.size(), 0);
+    for (const auto& spring : springs)
+    {
+        const Particle& p1 = particles[spring.p1];
+        const Particle& p2 = particles[spring.p2];
+        const double k = abs(spring.stiffness);
+        const double coupling = p1.mass > 0 && p2.mass > 0 ? k / sqrt((double)p1.mass * p2.mass) : 0;
+        if (p1.mass > 0)
+            rowSums[spring.p1] += k / p1.mass + coupling;
+        if (p2.mass > 0)
+            rowSums[spring.p2] += k / p2.mass + coupling;
+    }
+
+    double omegaSquared = 0;
+    double drag = 0;
+    for (size_t i = 0; i < particles.size(); i++)
+    {
+        if (particles[i].mass <= 0)
+            continue;
+        omegaSquared = max(omegaSquared, rowSums[i]);
+        drag = max(drag, (double)params.airDampening / particles[i].mass);
+    }
+
+    // the positive root of w^2 dt^2 + 2 g dt - 4
+    double timestep = INFINITY;
+    if (omegaSquared > 0)
+        timestep = (-drag + sqrt(drag * drag + 4 * omegaSquared)) / omegaSquared;
+    else if (drag > 0)
+        timestep = 2 / drag;
+
+    /*
+        A bounce moves the particle back up to the ground, which squeezes its
+        springs by however far below it landed, and that adds energy the
+        spring bound knows nothing about. So keep the landing shallow for the
+        fastest particle once everything above the ground has fallen to it.
+    */
+    if (params.ground)
+    {
+        float shortest = INFINITY;
+        for (const auto& spring : springs)
+        {
+            if (spring.restLength > 0)
+                shortest = min(shortest, spring.restLength);
+        }
+        double speedSquared = 0;
+        for (const auto& particle : particles)
+        {
+            if (particle.mass <= 0)
+                continue;
+            double fall = max(particle.position.y - params.groundHeight, 0.0f);
+            speedSquared = max(speedSquared, glm::dot(particle.velocity, particle.velocity) +
+                                             2 * glm::length(params.gravity) * fall);
+        }
+        if (isfinite(shortest) && speedSquared > 0)
+            timestep = min(timestep, CONTACT_DEPTH * shortest / sqrt(speedSquared));
+    }
+    return timestep;
+}
+
+AdaptiveSolver::AdaptiveSolver(float tolerance)
+: tolerance(tolerance)
+{
+}
+
+void AdaptiveSolver::reset()
+{
+    stepSize = FIRST_STEP;
+}
+
+void AdaptiveSolver::step(vector<Particle>& particles, const vector<Spring>& springs, const SimulationParams& params)
+{
+    SimulationParams substep = params;
+    float remaining = params.deltaT;
+    while (remaining > 0)
+    {
+        // the last substep is cut short to land on deltaT, which shouldn't shrink the next
+        const bool last = stepSize >= remaining;
+        const float size = last ? remaining : stepSize;
+
+        full = particles;
+        substep.deltaT = size;
+        explicitSolver.step(full, springs, substep);
+        halves = particles;
+        substep.deltaT = size / 2;
+        explicitSolver.step(halves, springs, substep);
+        explicitSolver.step(halves, springs, substep);
+
+        // symplectic Euler is first order, so the error of a substep goes as its size squared
+        float difference = error(full, halves, size);
+        float scale = MAX_SHRINK;          // when it blew up
+        if (difference == 0)
+            scale = MAX_GROWTH;
+        else if (difference > 0)
+            scale = min(max(SAFETY * sqrt(tolerance / difference), MAX_SHRINK), MAX_GROWTH);
+        if (difference <= tolerance || size <= MIN_STEP)
+        {
+            swap(particles, halves);
+            remaining -= size;
+            accepted++;
+            smallestStep = min(smallestStep, size);
+            largestStep = max(largestStep, size);
+            if (!last || scale < 1)
+                stepSize = max(size * scale, MIN_STEP);
+        }
+        else
+        {
+            rejected++;
+            stepSize = max(size * scale, MIN_STEP);
+        }
+    }
+}
+
+float AdaptiveSolver::error(const vector<Particle>& a, const vector<Particle>& b, float step) const
+{
+    float largest = 0;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        float position = glm::length(a[i].position - b[i].position);
+        float velocity = glm::length(a[i].velocity - b[i].velocity) * step;
+        if (isnan(position) || isnan(velocity))
+            return NAN;
+        largest = max(largest, max(position, velocity));
+    }
+    return largest;
+}
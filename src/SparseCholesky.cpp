@@ -0,0 +1,133 @@
+#include "SparseCholesky.h"
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+using namespace std;
+
+/*
+    Reverse Cuthill-McKee: breadth first from a low degree row of each
+    connected part, visiting neighbours lowest degree first, then reversed.
+*/
+void SparseCholesky::order(size_t size, const vector<Entry>& entries)
+{
+    vector<vector<size_t>> neighbours(size);
+    for (const auto& entry : entries)
+    {
+        if (entry.column < entry.row)
+        {
+            neighbours[entry.row].push_back(entry.column);
+            neighbours[entry.column].push_back(entry.row);
+        }
+    }
+    for (auto& list : neighbours)
+    {
+        sort(list.begin(), list.end());
+        list.erase(unique(list.begin(), list.end()), list.end());
+    }
+
+    vector<size_t> byDegree(size);
+    for (size_t i = 0; i < size; i++)
+        byDegree[i] = i;
+    stable_sort(byDegree.begin(), byDegree.end(), [&](size_t a, size_t b) {
+        return neighbours[a].size() < neighbours[b].size();
+    });
+
+    vector<size_t> visitOrder;
+    vector<bool> visited(size, false);
+    for (size_t start : byDegree)
+    {
+        if (visited[start])
+            continue;
+        queue<size_t> frontier;
+        frontier.push(start);
+        visited[start] = true;
+        while (!frontier.empty())
+        {
+            size_t row = frontier.front();
+            frontier.pop();
+            visitOrder.push_back(row);
+
+            vector<size_t> next;
+            for (size_t neighbour : neighbours[row])
+            {
+                if (!visited[neighbour])
+                {
+                    visited[neighbour] = true;
+                    next.push_back(neighbour);
+                }
+            }
+            stable_sort(next.begin(), next.end(), [&](size_t a, size_t b) {
+                return neighbours[a].size() < neighbours[b].size();
+            });
+            for (size_t neighbour : next)
+                frontier.push(neighbour);
+        }
+    }
+
+    permutation.resize(size);
+    for (size_t i = 0; i < size; i++)
+        permutation[visitOrder[i]] = size - 1 - i;
+}
+
+bool SparseCholesky::factor(size_t size, const vector<Entry>& entries)
+{
+    order(size, entries);
+
+    // the envelope of the renumbered matrix
+    first.resize(size);
+    for (size_t i = 0; i < size; i++)
+        first[i] = i;
+    for (const auto& entry : entries)
+    {
+        if (entry.column > entry.row)
+            continue;
+        size_t row = permutation[entry.row];
+        size_t column = permutation[entry.column];
+        if (column > row)
+            swap(row, column);
+        first[row] = min(first[row], column);
+    }
+    rowStart.resize(size + 1);
+    rowStart[0] = 0;
+    for (size_t i = 0; i < size; i++)
+        rowStart[i + 1] = rowStart[i] + (i - first[i]);
+
+    factors.assign(rowStart[size], 0);
+    diagonal.assign(size, 0);
+    for (const auto& entry : entries)
+    {
+        if (entry.column > entry.row)
+            continue;
+        size_t row = permutation[entry.row];
+        size_t column = permutation[entry.column];
+        if (column > row)
+            swap(row, column);
+        if (row == column)
+            diagonal[row] += entry.value;
+        else
+            factors[rowStart[row] + column - first[row]] += entry.value;
+    }
+
+    // row by row, each entry less the products of the rows to its left
+    for (size_t i = 0; i < size; i++)
+    {
+        double* rowI = &factors[rowStart[i]];
+        for (size_t j = first[i]; j < i; j++)
+        {
+            const double* rowJ = &factors[rowStart[j]];
+            double sum = rowI[j - first[i]];
+            for (size_t k = max(first[i], first[j]); k < j; k++)
+                sum -= rowI[k - first[i]] * rowJ[k - first[j]];
+            rowI[j - first[i]] = sum / diagonal[j];
+        }
+
+        double sum = diagonal[i];
+        for (size_t k = first[i]; k < i; k++)
+            sum -= rowI[k - first[i]] * rowI[k - first[i]];
+        if (!(sum > 0))
+            return false;
+        diagonal[i] = sqrt(sum);
+    }
+    return true;
+}
@@ -0,0 +1,72 @@
+#include "SurfaceMesh.h"
+#include <unordered_map>
+
+SurfaceMesh::SurfaceMesh(const std::vector<unsigned int>& particleTriangles)
+{
+    // only particles on the surface become vertices, so interior particles
+    // are never uploaded
+    std::unordered_map<unsigned int, unsigned int> surfaceIndex;
+    triangles.reserve(particleTriangles.size());
+    for (unsigned int particle : particleTriangles)
+    {
+        auto inserted = surfaceIndex.emplace(particle, particleIndices.size());
+        if (inserted.second)
+            particleIndices.push_back(particle);
+        triangles.push_back(inserted.first->second);
+    }
+
+    // count then fill the triangles around each vertex
+    const size_t vertexCount = particleIndices.size();
+    vertexTriangleOffsets.assign(vertexCount + 1, 0);
+    for (unsigned int vertex : triangles)
+        vertexTriangleOffsets[vertex + 1]++;
+    for (size_t i = 0; i < vertexCount; i++)
+        vertexTriangleOffsets[i + 1] += vertexTriangleOffsets[i];
+
+    std::vector<unsigned int> fill(vertexTriangleOffsets.begin(), vertexTriangleOffsets.end() - 1);
+    vertexTriangles.resize(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++)
+        vertexTriangles[fill[triangles[i]]++] = i / 3;
+
+    faceNormals.resize(triangles.size() / 3);
+    vertices.resize(vertexCount * 6);
+}
+
+std::vector<unsigned int> SurfaceMesh::getParticleTriangles() const
+{
+    std::vector<unsigned int> particleTriangles(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++)
+        particleTriangles[i] = particleIndices[triangles[i]];
+    return particleTriangles;
+}
+
+void SurfaceMesh::update(const std::vector<Particle>& particles, ThreadPool& threadPool)
+{
+    threadPool.parallelFor(0, faceNormals.size(), [&](size_t begin, size_t end) {
+        for (size_t face = begin; face < end; face++)
+        {
+            const glm::vec3& a = particles[particleIndices[triangles[face*3]]].position;
+            const glm::vec3& b = particles[particleIndices[triangles[face*3 + 1]]].position;
+            const glm::vec3& c = particles[particleIndices[triangles[face*3 + 2]]].position;
+            faceNormals[face] = glm::cross(b - a, c - a);     // length is twice the area
+        }
+    });
+
+    threadPool.parallelFor(0, particleIndices.size(), [&](size_t begin, size_t end) {
+        for (size_t vertex = begin; vertex < end; vertex++)
+        {
+            glm::vec3 normal(0);
+            for (unsigned int i = vertexTriangleOffsets[vertex]; i < vertexTriangleOffsets[vertex + 1]; i++)
+                normal += faceNormals[vertexTriangles[i]];
+
+            float length = glm::length(normal);
+            if (length > 0)
+                normal /= length;
+
+            const glm::vec3& position = particles[particleIndices[vertex]].position;
+            float* out = &vertices[vertex * 6];
+            out[0] = position.x; out[1] = position.y; out[2] = position.z;
+            out[3] = normal.x;   out[4] = normal.y;   out[5] = normal.z;
+        }
+    });
+}
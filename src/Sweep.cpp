@@ -0,0 +1,215 @@
+#include "Sweep.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+namespace
+{
+    // how often a run checks its energy, in steps
+    const size_t ENERGY_INTERVAL = 64;
+
+    float height(glm::vec3 position, glm::vec3 gravity)
+    {
+        float strength = glm::length(gravity);
+        return strength > 0 ? glm::dot(position, -gravity) / strength : 0;
+    }
+
+    SweepResult simulate(vector<Particle> particles, const vector<Spring>& springs, const SimulationParams& params,
+                         double seconds)
+    {
+        auto start = chrono::steady_clock::now();
+        SweepResult result = { true, 0, 0, 0, 0 };
+
+        float baseHeight = INFINITY;
+        for (const auto& particle : particles)
+            baseHeight = min(baseHeight, height(particle.position, params.gravity));
+        const double startEnergy = Sweep::energy(particles, springs, params.gravity, baseHeight);
+        // a scene that starts at rest and at the bottom has no energy to be relative to
+        const double scale = max(abs(startEnergy), 1e-9);
+
+        ExplicitSolver solver;
+        const size_t steps = max<long long>(1, llround(seconds / params.deltaT));
+        double energy = startEnergy;
+        for (result.steps = 0; result.steps < steps; )
+        {
+            solver.step(particles, springs, params);
+            result.steps++;
+            if (result.steps % ENERGY_INTERVAL != 0 && result.steps != steps)
+                continue;
+
+            energy = Sweep::energy(particles, springs, params.gravity, baseHeight);
+            if (!isfinite(energy) || energy - startEnergy > 0.01 * scale)
+            {
+                result.stable = false;
+                if (!isfinite(energy))
+                    break;      // nothing more to learn from it
+            }
+        }
+
+        result.energyDrift = (energy - startEnergy) / scale;
+        result.wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    bool parseRange(istringstream& fields, SweepRange& range)
+    {
+        if (!(fields >> range.first))
+            return false;
+        if (!(fields >> range.last))
+        {
+            range.last = range.first;
+            range.count = 1;
+            return true;
+        }
+        return (fields >> range.count) && range.count > 0;
+    }
+}
+
+bool Sweep::loadSpec(const string& path, SweepSpec& spec)
+{
+    ifstream file(path);
+    if (!file)
+    {
+        cerr << "Failed to open " << path << endl;
+        return false;
+    }
+
+    spec = SweepSpec();
+    map<string, SweepRange*> ranges = {
+        { "stiffness", &spec.stiffness },
+        { "dampening", &spec.dampening },
+        { "deltaT", &spec.deltaT },
+        { "airDampening", &spec.airDampening },
+        { "gridSize", &spec.gridSize }
+    };
+    string line;
+    for (size_t lineNumber = 1; getline(file, line); lineNumber++)
+    {
+        istringstream fields(line);
+        string name;
+        if (!(fields >> name) || name[0] == '#')
+            continue;
+
+        bool parsed;
+        if (name == "seconds")
+            parsed = (fields >> spec.seconds) && spec.seconds > 0;
+        else if (ranges.count(name))
+            parsed = parseRange(fields, *ranges[name]);
+        else
+        {
+            cerr << path << ":" << lineNumber << ": unknown parameter " << name << endl;
+            return false;
+        }
+        if (!parsed)
+        {
+            cerr << path << ":" << lineNumber << ": expected \"" << name << " first last count\" or \"" << name << " value\"" << endl;
+            return false;
+        }
+    }
+
+    if (spec.deltaT.count > 0 && min(spec.deltaT.first, spec.deltaT.last) <= 0)
+    {
+        cerr << path << ": deltaT must be positive" << endl;
+        return false;
+    }
+    return true;
+}
+
+vector<SweepRun> Sweep::expand(const SweepSpec& spec, unsigned int gridSize, float deltaT, float airDampening)
+{
+    // an unswept parameter counts as a range of one, dampening varies fastest
+    const SweepRange* ranges[] = { &spec.dampening, &spec.stiffness, &spec.airDampening, &spec.deltaT, &spec.gridSize };
+    size_t total = 1;
+    for (const SweepRange* range : ranges)
+        total *= max(range->count, 1u);
+
+    vector<SweepRun> runs;
+    for (size_t i = 0; i < total; i++)
+    {
+        unsigned int index[5];
+        size_t rest = i;
+        for (size_t r = 0; r < 5; r++)
+        {
+            index[r] = rest % max(ranges[r]->count, 1u);
+            rest /= max(ranges[r]->count, 1u);
+        }
+
+        SweepRun run;
+        run.dampening = spec.dampening.count > 0 ? spec.dampening.at(index[0]) : NAN;
+        run.stiffness = spec.stiffness.count > 0 ? spec.stiffness.at(index[1]) : NAN;
+        run.airDampening = spec.airDampening.count > 0 ? spec.airDampening.at(index[2]) : airDampening;
+        run.deltaT = spec.deltaT.count > 0 ? spec.deltaT.at(index[3]) : deltaT;
+        run.gridSize = spec.gridSize.count > 0 ? (unsigned int)lround(spec.gridSize.at(index[4])) : gridSize;
+        runs.push_back(run);
+    }
+    return runs;
+}
+
+vector<SweepResult> Sweep::run(const vector<SweepRun>& runs, const map<unsigned int, SweepScene>& scenes,
+                               double seconds, WorkStealingPool& pool)
+{
+    vector<SweepResult> results(runs.size());
+    pool.run(runs.size(), [&](size_t i, unsigned int thread) {
+        const SweepRun& run = runs[i];
+        const SweepScene& scene = scenes.at(run.gridSize);
+
+        vector<Spring> springs = scene.springs;
+        for (auto& spring : springs)
+        {
+            if (!isnan(run.stiffness))
+                spring.stiffness = run.stiffness;
+            if (!isnan(run.dampening))
+                spring.dampening = run.dampening;
+        }
+        SimulationParams params = scene.params;
+        params.deltaT = run.deltaT;
+        params.airDampening = run.airDampening;
+
+        results[i] = simulate(scene.particles, springs, params, seconds);
+        results[i].thread = thread;
+    });
+    return results;
+}
+
+void Sweep::writeResults(ostream& out, const vector<SweepRun>& runs, const vector<SweepResult>& results)
+{
+    // an empty stiffness or dampening is the scene's own
+    auto value = [](float x) {
+        ostringstream text;
+        if (!isnan(x))
+            text << x;
+        return text.str();
+    };
+
+    out << "run,grid_size,stiffness,dampening,delta_t,air_dampening,stable,energy_drift,steps,wall_ms,thread\n";
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        const SweepRun& run = runs[i];
+        const SweepResult& result = results[i];
+        out << i << ',' << run.gridSize << ',' << value(run.stiffness) << ',' << value(run.dampening) << ','
+            << run.deltaT << ',' << run.airDampening << ',' << result.stable << ',' << result.energyDrift << ','
+            << result.steps << ',' << result.wallSeconds * 1000 << ',' << result.thread << '\n';
+    }
+}
+
+double Sweep::energy(const vector<Particle>& particles, const vector<Spring>& springs, glm::vec3 gravity, float baseHeight)
+{
+    const float strength = glm::length(gravity);
+    double total = 0;
+    for (const auto& particle : particles)
+    {
+        if (particle.mass <= 0)
+            continue;
+        total += 0.5 * particle.mass * glm::dot(particle.velocity, particle.velocity);
+        total += particle.mass * strength * (height(particle.position, gravity) - baseHeight);
+    }
+    for (const auto& spring : springs)
+    {
+        double stretch = glm::distance(particles[spring.p1].position, particles[spring.p2].position) - spring.restLength;
+        total += 0.5 * spring.stiffness * stretch * stretch;
+    }
+    return total;
+}
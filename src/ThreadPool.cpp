@@ -0,0 +1,128 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+    if (threadCount == 0)
+    {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+    }
+
+    for (unsigned int i = 0; i < threadCount; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    taskAvailable.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    if (workers.empty())        // nobody to hand it to
+    {
+        task();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    taskAvailable.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    tasksFinished.wait(lock, [this] { return tasks.empty() && busyWorkers == 0; });
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            taskAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty())
+                return;
+
+            task = std::move(tasks.front());
+            tasks.pop_front();
+            busyWorkers++;
+        }
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busyWorkers--;
+        }
+        tasksFinished.notify_all();
+    }
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)>& body, size_t minChunk)
+{
+    if (end <= begin)
+        return;
+
+    const size_t count = end - begin;
+    const size_t maxChunks = (workers.size() + 1) * 4;      // a few per thread to even out uneven chunks
+    const size_t chunks = std::max<size_t>(1, std::min(maxChunks, count / std::max<size_t>(minChunk, 1)));
+    if (chunks == 1 || workers.empty())
+    {
+        body(begin, end);
+        return;
+    }
+
+    // chunks are claimed from a shared counter by the workers and by this thread,
+    // so the call returns as soon as the last chunk is done. A helper that only
+    // starts after that finds no chunks left and never touches body, but the
+    // counters it reads must outlive this call, hence the shared_ptr.
+    struct Progress
+    {
+        std::atomic<size_t> nextChunk{0};
+        std::atomic<size_t> remaining{0};
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+    auto progress = std::make_shared<Progress>();
+    progress->remaining = chunks;
+    const size_t chunkSize = (count + chunks - 1) / chunks;
+    const std::function<void(size_t, size_t)>* bodyPtr = &body;
+
+    auto runChunks = [progress, bodyPtr, begin, end, chunks, chunkSize]() {
+        size_t chunk;
+        while ((chunk = progress->nextChunk.fetch_add(1)) < chunks)
+        {
+            size_t chunkBegin = begin + chunk * chunkSize;
+            size_t chunkEnd = std::min(end, chunkBegin + chunkSize);
+            (*bodyPtr)(chunkBegin, chunkEnd);
+            if (progress->remaining.fetch_sub(1) == 1)
+            {
+                std::lock_guard<std::mutex> lock(progress->mutex);
+                progress->done.notify_all();
+            }
+        }
+    };
+
+    size_t helpers = std::min<size_t>(workers.size(), chunks - 1);
+    for (size_t i = 0; i < helpers; i++)
+        submit(runChunks);
+    runChunks();
+
+    std::unique_lock<std::mutex> lock(progress->mutex);
+    progress->done.wait(lock, [&] { return progress->remaining.load() == 0; });
+}
@@ -0,0 +1,168 @@
+#include "Trajectory.h"
+#include <cmath>
+#include <cstring>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+    void writeVarint(uint32_t value, vector<unsigned char>& out)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        out.push_back(value);
+    }
+
+    // small magnitudes of either sign become small unsigned values
+    uint32_t zigzag(int32_t value)
+    {
+        return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    }
+
+    int32_t unzigzag(uint32_t value)
+    {
+        return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+    }
+}
+
+Trajectory::Compression Trajectory::defaultCompression()
+{
+#ifdef HAVE_ZSTD
+    return Compression::Zstd;
+#else
+    return Compression::ZeroRuns;
+#endif
+}
+
+void Trajectory::encodeFrame(const float positions[], size_t count, double time, float step, bool keyframe,
+                             vector<int32_t>& previous, vector<unsigned char>& block)
+{
+    size_t start = block.size();
+    block.resize(start + sizeof(time));
+    memcpy(&block[start], &time, sizeof(time));
+
+    previous.resize(count);
+    const float inverseStep = 1 / step;
+    for (size_t i = 0; i < count; i++)
+    {
+        int32_t quantized = lrintf(positions[i] * inverseStep);
+        writeVarint(zigzag(keyframe ? quantized : quantized - previous[i]), block);
+        previous[i] = quantized;
+    }
+}
+
+size_t Trajectory::decodeFrame(const vector<unsigned char>& block, size_t offset, size_t count, float step, bool keyframe,
+                               vector<int32_t>& previous, float positions[], double& time)
+{
+    if (offset + sizeof(time) > block.size())
+        return 0;
+    memcpy(&time, &block[offset], sizeof(time));
+    offset += sizeof(time);
+
+    previous.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t value = 0;
+        for (int shift = 0; ; shift += 7)
+        {
+            if (offset >= block.size() || shift > 28)
+                return 0;
+            unsigned char byte = block[offset++];
+            value |= (uint32_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                break;
+        }
+        previous[i] = keyframe ? unzigzag(value) : previous[i] + unzigzag(value);
+        positions[i] = previous[i] * step;
+    }
+    return offset;
+}
+
+bool Trajectory::compress(Compression compression, const vector<unsigned char>& raw, vector<unsigned char>& stored)
+{
+    stored.clear();
+    switch (compression)
+    {
+        case Compression::Uncompressed :
+            stored = raw;
+            return true;
+
+        case Compression::ZeroRuns :
+            // resting and pinned particles encode as runs of zero deltas
+            stored.reserve(raw.size());
+            for (size_t i = 0; i < raw.size(); )
+            {
+                if (raw[i] != 0)
+                {
+                    stored.push_back(raw[i++]);
+                    continue;
+                }
+                size_t run = 1;
+                while (i + run < raw.size() && raw[i + run] == 0 && run < 255)
+                    run++;
+                stored.push_back(0);
+                stored.push_back(run);
+                i += run;
+            }
+            return true;
+
+        case Compression::Zstd :
+#ifdef HAVE_ZSTD
+        {
+            stored.resize(ZSTD_compressBound(raw.size()));
+            size_t size = ZSTD_compress(stored.data(), stored.size(), raw.data(), raw.size(), 3);
+            if (ZSTD_isError(size))
+                return false;
+            stored.resize(size);
+            return true;
+        }
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+bool Trajectory::decompress(Compression compression, const unsigned char stored[], size_t storedSize, size_t rawSize,
+                            vector<unsigned char>& raw)
+{
+    raw.clear();
+    switch (compression)
+    {
+        case Compression::Uncompressed :
+            raw.assign(stored, stored + storedSize);
+            return raw.size() == rawSize;
+
+        case Compression::ZeroRuns :
+            raw.reserve(rawSize);
+            for (size_t i = 0; i < storedSize; i++)
+            {
+                if (stored[i] != 0)
+                    raw.push_back(stored[i]);
+                else if (i + 1 < storedSize)
+                    raw.insert(raw.end(), stored[++i], 0);
+                else
+                    return false;
+            }
+            return raw.size() == rawSize;
+
+        case Compression::Zstd :
+#ifdef HAVE_ZSTD
+        {
+            raw.resize(rawSize);
+            size_t size = ZSTD_decompress(raw.data(), raw.size(), stored, storedSize);
+            return !ZSTD_isError(size) && size == rawSize;
+        }
+#else
+            return false;
+#endif
+    }
+    return false;
+}
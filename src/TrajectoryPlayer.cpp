@@ -0,0 +1,267 @@
+#include "TrajectoryPlayer.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+TrajectoryPlayer::~TrajectoryPlayer()
+{
+    if (!prefetcher.joinable())
+        return;
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    prefetcher.join();
+}
+
+bool TrajectoryPlayer::open(const string& path)
+{
+    // playback jumps around, so no sequential read ahead
+    if (!file.open(path, false))
+        return false;
+    if (file.size() < sizeof(header) || memcmp(file.data(), Trajectory::MAGIC, sizeof(Trajectory::MAGIC)) != 0)
+    {
+        cerr << path << " is not a trajectory file" << endl;
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    if (header.framesPerBlock == 0 || header.step <= 0 || header.frameInterval <= 0)
+    {
+        cerr << path << " has a bad header" << endl;
+        return false;
+    }
+
+    bool indexed = readIndex();
+    if (!indexed && !rebuildIndex())
+    {
+        cerr << path << " has no readable frames" << endl;
+        return false;
+    }
+    if (!indexed)
+        cerr << path << " has no usable frame index, it was probably cut short. Found " << frameCount << " frames" << endl;
+
+    // a handful of blocks, or as many as fit in about 256 MB
+    size_t blockBytes = (size_t)header.framesPerBlock * header.particleCount * 3 * sizeof(float);
+    cacheCapacity = clamp<size_t>((256u << 20) / max<size_t>(blockBytes, 1), 2, 8);
+    prefetcher = thread(&TrajectoryPlayer::prefetchLoop, this);
+    return true;
+}
+
+/*
+    Reads the index the recorder wrote at the end of the file. Nothing in
+    it is trusted: every entry has to point at a block that fits in the
+    file and agrees with it, and the blocks have to follow on from each
+    other and add up to the footer's frame count. Otherwise false is
+    returned and open falls back to rebuildIndex.
+*/
+bool TrajectoryPlayer::readIndex()
+{
+    index.clear();
+    frameCount = 0;
+    Trajectory::Footer footer;
+    const size_t size = file.size();
+    if (size < sizeof(header) + sizeof(footer))
+        return false;
+    memcpy(&footer, file.data() + size - sizeof(footer), sizeof(footer));
+
+    // the index runs from indexOffset right up to the footer, compared without overflowing
+    const size_t indexEnd = size - sizeof(footer);
+    if (memcmp(footer.magic, Trajectory::FOOTER_MAGIC, sizeof(footer.magic)) != 0 || footer.blockCount == 0 ||
+        footer.indexOffset < sizeof(header) || footer.indexOffset > indexEnd ||
+        (indexEnd - footer.indexOffset) / sizeof(Trajectory::BlockIndex) != footer.blockCount ||
+        (indexEnd - footer.indexOffset) % sizeof(Trajectory::BlockIndex) != 0)
+        return false;
+
+    vector<Trajectory::BlockIndex> entries(footer.blockCount);
+    memcpy(entries.data(), file.data() + footer.indexOffset, entries.size() * sizeof(Trajectory::BlockIndex));
+    size_t frames = 0;
+    for (const auto& entry : entries)
+    {
+        Trajectory::BlockHeader blockHeader;
+        if (!readBlockHeader(entry.offset, blockHeader) ||
+            entry.offset + sizeof(blockHeader) + blockHeader.storedSize > footer.indexOffset ||
+            entry.firstFrame != frames || blockHeader.firstFrame != entry.firstFrame ||
+            entry.frameCount != blockHeader.frameCount)
+            return false;
+        frames += entry.frameCount;
+    }
+    if (frames != footer.frameCount)
+        return false;
+
+    index = move(entries);
+    frameCount = frames;
+    return true;
+}
+
+/*
+    Reads the header of the block at offset, returning false unless the
+    block fits in the file and holds between 1 and framesPerBlock frames.
+*/
+bool TrajectoryPlayer::readBlockHeader(size_t offset, Trajectory::BlockHeader& blockHeader) const
+{
+    if (offset < sizeof(header) || offset > file.size() || file.size() - offset < sizeof(blockHeader))
+        return false;
+    memcpy(&blockHeader, file.data() + offset, sizeof(blockHeader));
+    return blockHeader.storedSize <= file.size() - offset - sizeof(blockHeader) &&
+           blockHeader.frameCount > 0 && blockHeader.frameCount <= header.framesPerBlock;
+}
+
+/*
+    A recording that never finished has no index, so walk the blocks from
+    the start instead, stopping at the first one that was cut off.
+*/
+bool TrajectoryPlayer::rebuildIndex()
+{
+    index.clear();
+    frameCount = 0;
+    size_t offset = sizeof(header);
+    Trajectory::BlockHeader blockHeader;
+    while (readBlockHeader(offset, blockHeader) && blockHeader.firstFrame == frameCount)
+    {
+        index.push_back({ offset, blockHeader.firstFrame, blockHeader.frameCount });
+        frameCount += blockHeader.frameCount;
+        offset += sizeof(blockHeader) + blockHeader.storedSize;
+    }
+    return !index.empty();
+}
+
+size_t TrajectoryPlayer::findBlock(size_t frame) const
+{
+    auto after = upper_bound(index.begin(), index.end(), frame,
+        [](size_t value, const Trajectory::BlockIndex& block) { return value < block.firstFrame; });
+    return after == index.begin() ? 0 : after - index.begin() - 1;
+}
+
+shared_ptr<const TrajectoryPlayer::DecodedBlock> TrajectoryPlayer::decode(size_t block) const
+{
+    const Trajectory::BlockIndex& entry = index[block];
+    Trajectory::BlockHeader blockHeader;
+    if (!readBlockHeader(entry.offset, blockHeader) || blockHeader.frameCount != entry.frameCount)
+        return nullptr;
+
+    auto decoded = make_shared<DecodedBlock>();
+    decoded->block = block;
+    vector<unsigned char> raw;
+    const unsigned char* stored = (const unsigned char*)file.data() + entry.offset + sizeof(blockHeader);
+    if (!Trajectory::decompress((Trajectory::Compression)header.compression, stored, blockHeader.storedSize, blockHeader.rawSize, raw))
+        return nullptr;
+
+    const size_t floatsPerFrame = header.particleCount * 3;
+    decoded->positions.resize(entry.frameCount * floatsPerFrame);
+    decoded->times.resize(entry.frameCount);
+    vector<int32_t> previous;
+    size_t offset = 0;
+    for (size_t frame = 0; frame < entry.frameCount; frame++)
+    {
+        offset = Trajectory::decodeFrame(raw, offset, floatsPerFrame, header.step, frame == 0, previous,
+                                         &decoded->positions[frame * floatsPerFrame], decoded->times[frame]);
+        if (offset == 0)
+            return nullptr;
+    }
+    return decoded;
+}
+
+shared_ptr<const TrajectoryPlayer::DecodedBlock> TrajectoryPlayer::cached(size_t block) const
+{
+    for (const auto& decoded : cache)
+    {
+        if (decoded->block == block)
+            return decoded;
+    }
+    return nullptr;
+}
+
+void TrajectoryPlayer::insert(shared_ptr<const DecodedBlock> decoded)
+{
+    if (cached(decoded->block))
+        return;
+    cache.push_back(decoded);
+    if (cache.size() <= cacheCapacity)
+        return;
+
+    // drop the block furthest from the one being played, counting around the loop
+    auto distance = [this](size_t block) {
+        size_t gap = block > wantedBlock ? block - wantedBlock : wantedBlock - block;
+        return min(gap, index.size() - gap);
+    };
+    auto furthest = max_element(cache.begin(), cache.end(),
+        [&](const shared_ptr<const DecodedBlock>& a, const shared_ptr<const DecodedBlock>& b) {
+            return distance(a->block) < distance(b->block);
+        });
+    cache.erase(furthest);
+}
+
+bool TrajectoryPlayer::getFrame(size_t frame, int direction, float positions[], double& time)
+{
+    if (frame >= frameCount)
+        return false;
+    size_t block = findBlock(frame);
+
+    shared_ptr<const DecodedBlock> decoded;
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        decoded = cached(block);
+        wantedBlock = block;
+        wantedDirection = direction < 0 ? -1 : 1;
+    }
+    wake.notify_one();
+
+    if (!decoded)
+    {
+        misses++;
+        decoded = decode(block);
+        if (!decoded)
+            return false;
+        lock_guard<mutex> lock(cacheMutex);
+        insert(decoded);
+    }
+
+    const size_t inBlock = frame - index[block].firstFrame;
+    const size_t floatsPerFrame = header.particleCount * 3;
+    if (inBlock >= decoded->times.size())
+        return false;
+    copy_n(&decoded->positions[inBlock * floatsPerFrame], floatsPerFrame, positions);
+    time = decoded->times[inBlock];
+    return true;
+}
+
+void TrajectoryPlayer::prefetchLoop()
+{
+    unique_lock<mutex> lock(cacheMutex);
+    while (!stopping)
+    {
+        // the next blocks ahead of the playhead, wrapping around since playback loops
+        size_t missing = index.size();
+        for (size_t ahead = 0; ahead < min<size_t>(cacheCapacity - 1, index.size()); ahead++)
+        {
+            size_t block = (wantedBlock + index.size() + wantedDirection * (long)ahead) % index.size();
+            if (!cached(block))
+            {
+                missing = block;
+                break;
+            }
+        }
+        if (missing == index.size())
+        {
+            wake.wait(lock);
+            continue;
+        }
+
+        const size_t wanted = wantedBlock;
+        lock.unlock();
+        shared_ptr<const DecodedBlock> decoded = decode(missing);
+        lock.lock();
+        if (!decoded)
+        {
+            // a damaged block, leave it to getFrame to report. A wake while decoding would be lost, so only
+            // wait if nothing changed meanwhile
+            if (!stopping && wantedBlock == wanted)
+                wake.wait(lock);
+            continue;
+        }
+        insert(decoded);
+    }
+}
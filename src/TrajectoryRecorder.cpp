@@ -0,0 +1,155 @@
+#include "TrajectoryRecorder.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+namespace
+{
+    // up to 64 frames in flight, but no more than about 256 MB of them
+    size_t queueCapacity(size_t particleCount)
+    {
+        size_t frameBytes = max<size_t>(particleCount * 3 * sizeof(float), 1);
+        return clamp<size_t>((256u << 20) / frameBytes, 4, 64);
+    }
+}
+
+TrajectoryRecorder::TrajectoryRecorder(size_t particleCount, float frameInterval, float step, unsigned int framesPerBlock)
+: queue(queueCapacity(particleCount))
+{
+    memcpy(header.magic, Trajectory::MAGIC, sizeof(header.magic));
+    header.particleCount = particleCount;
+    header.framesPerBlock = max(framesPerBlock, 1u);
+    header.step = step;
+    header.frameInterval = frameInterval;
+    header.compression = Trajectory::defaultCompression();
+
+    // allocate every slot now so recording never allocates
+    for (auto& frame : queue.getSlots())
+        frame.positions.resize(particleCount * 3);
+}
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+    finish();
+}
+
+bool TrajectoryRecorder::open(const string& path)
+{
+    file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        cerr << "Failed to open " << path << " for writing" << endl;
+        return false;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    writer = thread(&TrajectoryRecorder::writerLoop, this);
+    return true;
+}
+
+void TrajectoryRecorder::record(const vector<Particle>& particles, double time)
+{
+    if (!file)
+        return;
+
+    Frame* frame = queue.beginPush();
+    if (!frame)
+    {
+        framesDropped++;
+        return;
+    }
+    float* positions = frame->positions.data();
+    const size_t count = min<size_t>(particles.size(), header.particleCount);
+    for (size_t i = 0; i < count; i++)
+    {
+        positions[i*3] = particles[i].position.x;
+        positions[i*3 + 1] = particles[i].position.y;
+        positions[i*3 + 2] = particles[i].position.z;
+    }
+    frame->time = time;
+    queue.endPush();
+}
+
+void TrajectoryRecorder::finish()
+{
+    if (!writer.joinable())
+        return;
+    stopping.store(true, memory_order_release);
+    writer.join();
+    fclose(file);
+    file = nullptr;
+    if (framesDropped > 0)
+        cerr << "Trajectory writer fell behind, dropped " << framesDropped << " frames" << endl;
+}
+
+void TrajectoryRecorder::writerLoop()
+{
+    while (true)
+    {
+        Frame* frame = queue.front();
+        if (frame)
+        {
+            writeFrame(*frame);
+            queue.pop();
+            continue;
+        }
+        // check stopping before the queue again, so a frame pushed just before stopping is still written
+        if (stopping.load(memory_order_acquire))
+        {
+            if (queue.front())
+                continue;
+            break;
+        }
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    flushBlock();
+    writeIndex();
+}
+
+void TrajectoryRecorder::writeFrame(const Frame& frame)
+{
+    Trajectory::encodeFrame(frame.positions.data(), frame.positions.size(), frame.time, header.step,
+                            blockFrames == 0, previous, block);
+    blockFrames++;
+    framesWritten++;
+    if (blockFrames == header.framesPerBlock)
+        flushBlock();
+}
+
+void TrajectoryRecorder::flushBlock()
+{
+    if (blockFrames == 0 || failed)
+        return;
+
+    if (!Trajectory::compress((Trajectory::Compression)header.compression, block, stored))
+    {
+        cerr << "Failed to compress a trajectory block" << endl;
+        failed = true;
+        return;
+    }
+
+    Trajectory::BlockHeader blockHeader = { framesWritten - blockFrames, blockFrames, (uint32_t)block.size(), (uint32_t)stored.size() };
+    index.push_back({ (uint64_t)ftello(file), blockHeader.firstFrame, blockHeader.frameCount });
+    fwrite(&blockHeader, sizeof(blockHeader), 1, file);
+    if (fwrite(stored.data(), 1, stored.size(), file) != stored.size())
+    {
+        cerr << "Failed to write a trajectory block" << endl;
+        failed = true;
+    }
+    block.clear();
+    blockFrames = 0;
+}
+
+void TrajectoryRecorder::writeIndex()
+{
+    Trajectory::Footer footer;
+    footer.indexOffset = ftello(file);
+    footer.blockCount = index.size();
+    footer.frameCount = index.empty() ? 0 : index.back().firstFrame + index.back().frameCount;
+    memcpy(footer.magic, Trajectory::FOOTER_MAGIC, sizeof(footer.magic));
+    fwrite(index.data(), sizeof(Trajectory::BlockIndex), index.size(), file);
+    fwrite(&footer, sizeof(footer), 1, file);
+}
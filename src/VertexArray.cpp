@@ -1,45 +1,84 @@
 #include "VertexArray.h"
+#include "GLState.h"
 #include <iostream>
 
 using namespace std;
 
 VertexArray::VertexArray(
     const int componentsPerAttribute[], size_t vertCompSize, const float buffer[], size_t buffSize, GLenum _drawType)
-: drawType(_drawType)
+: drawType(_drawType), componentsPerAttribute(componentsPerAttribute, componentsPerAttribute + vertCompSize)
 {
     glGenBuffers(1, &vbo); // gen buffer and store id in VBO
 	glGenBuffers(1, &ebo);
     glGenVertexArrays(1, &id);
     
-    glBindVertexArray(id);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    GLState::bindVertexArray(id);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, vbo);
 	glBufferData(GL_ARRAY_BUFFER,  buffSize * sizeof(float), buffer, drawType);
 
-    const int totalComponents = sumArray(0, vertCompSize, componentsPerAttribute);
-    const int stride = totalComponents * sizeof(float);
-    for(unsigned int i = 0; i < vertCompSize; i++)
-    {
-        int components = componentsPerAttribute[i];
-        int offset = sumArray(0, i, componentsPerAttribute);
+    setAttributePointers(GL_FLOAT, GL_FALSE, sizeof(float));
 
-        glVertexAttribPointer(i, components, GL_FLOAT, GL_FALSE, stride, (void*)(offset * sizeof(float)));
-	    glEnableVertexAttribArray(i);    
-    }
+    // the VAO, VBO and EBO stay bound; GLState switches away from them when
+    // something else is used
+}
 
+VertexArray::VertexArray(const VertexArray& source, GLuint divisor)
+: vbo(source.vbo), ebo(0), drawType(source.drawType), ownsBuffers(false),
+  componentsPerAttribute(source.componentsPerAttribute)
+{
+    glGenVertexArrays(1, &id);
 
-	// unbind VAO, VBO, and EBO
-	glBindVertexArray(0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    GLState::bindVertexArray(id);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, vbo);
+    setAttributePointers(GL_FLOAT, GL_FALSE, sizeof(float));
+    for (unsigned int i = 0; i < componentsPerAttribute.size(); i++)
+        glVertexAttribDivisor(i, divisor);
 }
 
 VertexArray::~VertexArray()
 {
     // cout << "DELETEING VERTEX ARRAY" << id << endl;
-    glDeleteVertexArrays(1, &id);
-	glDeleteBuffers(1, &vbo);
+    GLState::deleteVertexArray(id);
+    if (ownsBuffers)
+    {
+        GLState::deleteBuffer(vbo);
+        GLState::deleteBuffer(ebo);
+    }
+}
+
+void VertexArray::setAttributePointers(GLenum type, GLboolean normalized, size_t typeSize)
+{
+    const int vertCompSize = componentsPerAttribute.size();
+    const int totalComponents = sumArray(0, vertCompSize, componentsPerAttribute.data());
+    const int stride = totalComponents * typeSize;
+    for(int i = 0; i < vertCompSize; i++)
+    {
+        int components = componentsPerAttribute[i];
+        int offset = sumArray(0, i, componentsPerAttribute.data());
+
+        glVertexAttribPointer(i, components, type, normalized, stride, (void*)(offset * typeSize));
+	    glEnableVertexAttribArray(i);    
+    }
+}
+
+void VertexArray::setAttributeType(GLenum type, GLboolean normalized)
+{
+    size_t typeSize = sizeof(float);
+    switch (type)
+    {
+        case GL_UNSIGNED_SHORT:
+        case GL_SHORT:
+        case GL_HALF_FLOAT:
+            typeSize = sizeof(unsigned short); break;
+        case GL_UNSIGNED_BYTE:
+        case GL_BYTE:
+            typeSize = sizeof(unsigned char); break;
+    }
+
+    GLState::bindVertexArray(id);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, vbo);
+    setAttributePointers(type, normalized, typeSize);
 }
 
 int VertexArray::sumArray(int start, int end, const int array[]) const
@@ -54,30 +93,34 @@ int VertexArray::sumArray(int start, int end, const int array[]) const
 
 void VertexArray::use() const
 {
-    glBindVertexArray(id);
+    GLState::bindVertexArray(id);
 }
 
 void VertexArray::unuse() const
 {
-    glBindVertexArray(0);
+    // left bound on purpose, the next use() of another vertex array replaces it
 }
 
 void VertexArray::updateBuffer(const float buffer[], size_t buffSize)
 {
-    glBindVertexArray(id);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    // the array buffer binding isn't vertex array state, so no need to bind the VAO
+    GLState::bindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferSubData(GL_ARRAY_BUFFER, 0, buffSize * sizeof(float), buffer);
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    GLState::countCalls();
+}
+
+void VertexArray::updateBuffer(const unsigned short buffer[], size_t buffSize)
+{
+    GLState::bindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, buffSize * sizeof(unsigned short), buffer);
+    GLState::countCalls();
 }
 
 void VertexArray::setElementBuffer(const unsigned int buffer[], size_t buffSize)
 {
-    glBindVertexArray(id);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    GLState::bindVertexArray(id);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, buffSize * sizeof(unsigned int), buffer, drawType);
-    glBindVertexArray(0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
 
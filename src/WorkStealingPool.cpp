@@ -0,0 +1,78 @@
+#include "WorkStealingPool.h"
+#include <algorithm>
+#include <thread>
+
+WorkStealingPool::WorkStealingPool(unsigned int threadCount)
+: threadCount(threadCount > 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency())), shares(this->threadCount)
+{
+}
+
+void WorkStealingPool::run(size_t count, const std::function<void(size_t, unsigned int)>& task)
+{
+    steals = 0;
+    for (unsigned int thread = 0; thread < threadCount; thread++)
+    {
+        size_t begin = count * thread / threadCount;
+        size_t end = count * (thread + 1) / threadCount;
+        for (size_t index = begin; index < end; index++)
+            shares[thread].tasks.push_back(index);
+    }
+
+    std::vector<std::thread> helpers;
+    for (unsigned int thread = 1; thread < threadCount; thread++)
+        helpers.emplace_back(&WorkStealingPool::work, this, thread, std::cref(task));
+    work(0, task);
+    for (auto& helper : helpers)
+        helper.join();
+}
+
+void WorkStealingPool::work(unsigned int thread, const std::function<void(size_t, unsigned int)>& task)
+{
+    size_t index;
+    while (takeOwn(thread, index) || steal(thread, index))
+        task(index, thread);
+}
+
+bool WorkStealingPool::takeOwn(unsigned int thread, size_t& task)
+{
+    std::lock_guard<std::mutex> lock(shares[thread].lock);
+    if (shares[thread].tasks.empty())
+        return false;
+    task = shares[thread].tasks.front();
+    shares[thread].tasks.pop_front();
+    return true;
+}
+
+/*
+    Takes the last task of whichever share has the most left. Tasks are never
+    added during a run, so once every share looks empty the run is over.
+*/
+bool WorkStealingPool::steal(unsigned int thread, size_t& task)
+{
+    while (true)
+    {
+        unsigned int victim = thread;
+        size_t most = 0;
+        for (unsigned int other = 0; other < threadCount; other++)
+        {
+            if (other == thread)
+                continue;
+            std::lock_guard<std::mutex> lock(shares[other].lock);
+            if (shares[other].tasks.size() > most)
+            {
+                most = shares[other].tasks.size();
+                victim = other;
+            }
+        }
+        if (most == 0)
+            return false;
+
+        std::lock_guard<std::mutex> lock(shares[victim].lock);
+        if (shares[victim].tasks.empty())
+            continue;       // its owner or another thief got there first
+        task = shares[victim].tasks.back();
+        shares[victim].tasks.pop_back();
+        steals++;
+        return true;
+    }
+}
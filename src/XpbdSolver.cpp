@@ -0,0 +1,248 @@
+#include "XpbdSolver.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+using namespace std;
+
+namespace
+{
+    const float EPSILON = 1E-5;
+
+    float inverseMass(const Particle& particle)
+    {
+        return particle.mass > 0 ? particle.weight : 0;
+    }
+}
+
+XpbdSolver::XpbdSolver(unsigned int iterations, ThreadPool& pool, float tolerance)
+: iterations(max(iterations, 1u)), pool(pool), tolerance(tolerance)
+{
+}
+
+void XpbdSolver::setScene(const vector<Particle>& particles, const vector<Spring>& springs, const SimulationParams&)
+{
+    color(particles, springs);
+}
+
+void XpbdSolver::reset()
+{
+    fill(lambdas.begin(), lambdas.end(), 0.0f);
+    lambdaDeltaT = 0;
+}
+
+string XpbdSolver::describe() const
+{
+    string text = "XPBD with " + to_string(iterations) + " iterations over " + to_string(getColorCount()) + " colors";
+    if (tolerance > 0)
+        text += ", stopping at a relative residual of " + to_string(tolerance);
+    return text;
+}
+
+string XpbdSolver::statistics() const
+{
+    if (steps == 0)
+        return string();
+    ostringstream text;
+    text << "XPBD took " << (double)iterationsRun / steps << " iterations per step over " << steps << " steps";
+    return text.str();
+}
+
+/*
+    Greedy coloring, each spring taking the lowest color neither of its
+    particles has yet. Static particles never move, so springs may share
+    one within a color, as long as nothing writes to them at all.
+*/
+void XpbdSolver::color(const vector<Particle>& particles, const vector<Spring>& springs)
+{
+    vector<vector<unsigned int>> particleColors(particles.size());
+    vector<unsigned int> springColors(springs.size());
+    size_t colorCount = 0;
+    for (size_t s = 0; s < springs.size(); s++)
+    {
+        vector<unsigned int>* ends[2] = { nullptr, nullptr };
+        if (particles[springs[s].p1].mass > 0)
+            ends[0] = &particleColors[springs[s].p1];
+        if (particles[springs[s].p2].mass > 0)
+            ends[1] = &particleColors[springs[s].p2];
+
+        unsigned int color = 0;
+        auto taken = [&](unsigned int c) {
+            for (auto end : ends)
+            {
+                if (end && find(end->begin(), end->end(), c) != end->end())
+                    return true;
+            }
+            return false;
+        };
+        while (taken(color))
+            color++;
+
+        for (auto end : ends)
+        {
+            if (end)
+                end->push_back(color);
+        }
+        springColors[s] = color;
+        colorCount = max<size_t>(colorCount, color + 1);
+    }
+
+    // bucket the springs by color, keeping their order within a color
+    colorStarts.assign(colorCount + 1, 0);
+    for (unsigned int color : springColors)
+        colorStarts[color + 1]++;
+    for (size_t c = 0; c < colorCount; c++)
+        colorStarts[c + 1] += colorStarts[c];
+    order.resize(springs.size());
+    vector<size_t> next(colorStarts.begin(), colorStarts.end() - 1);
+    for (size_t s = 0; s < springs.size(); s++)
+        order[next[springColors[s]]++] = s;
+
+    lambdas.assign(springs.size(), 0);
+    chunkResiduals.assign(springs.size() / MIN_CHUNK + 1, 0);
+}
+
+/*
+    Moves the particles by WARM_START of the multipliers the last step
+    ended with, a color at a time like the projections. Multipliers scale
+    with the step squared, so a different step scales them too.
+*/
+void XpbdSolver::warmStart(vector<Particle>& particles, const vector<Spring>& springs, float deltaT)
+{
+    float scale = WARM_START;
+    if (lambdaDeltaT != deltaT)
+        scale *= lambdaDeltaT > 0 ? (deltaT * deltaT) / (lambdaDeltaT * lambdaDeltaT) : 0;
+    lambdaDeltaT = deltaT;
+    for (auto& lambda : lambdas)
+        lambda *= scale;
+
+    for (size_t c = 0; c + 1 < colorStarts.size(); c++)
+    {
+        pool.parallelFor(colorStarts[c], colorStarts[c + 1], [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                const Spring& spring = springs[order[i]];
+                Particle& p1 = particles[spring.p1];
+                Particle& p2 = particles[spring.p2];
+                glm::vec3 difference = p1.position - p2.position;
+                float distance = glm::length(difference);
+                if (distance < EPSILON || lambdas[order[i]] == 0)
+                    continue;
+                glm::vec3 direction = difference / distance;
+                const float w1 = inverseMass(p1);
+                const float w2 = inverseMass(p2);
+                if (w1 > 0)
+                    p1.position += w1 * lambdas[order[i]] * direction;
+                if (w2 > 0)
+                    p2.position -= w2 * lambdas[order[i]] * direction;
+            }
+        }, MIN_CHUNK);
+    }
+}
+
+/*
+    Predicts positions from the external forces, projects every constraint
+    iterations times, then takes velocities from how far each particle
+    moved. The ground is a constraint too, so particles land on it rather
+    than bouncing.
+*/
+void XpbdSolver::step(vector<Particle>& particles, const vector<Spring>& springs, const SimulationParams& params)
+{
+    if (order.size() != springs.size())
+        color(particles, springs);
+
+    const float deltaT = params.deltaT;
+    previous.resize(particles.size());
+    pool.parallelFor(0, particles.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            Particle& particle = particles[i];
+            previous[i] = particle.position;
+            if (particle.mass <= 0)
+                continue;
+            glm::vec3 force = particle.mass * params.gravity - params.airDampening * particle.velocity;
+            particle.velocity += force * particle.weight * deltaT;
+            particle.position += particle.velocity * deltaT;
+        }
+    }, MIN_CHUNK);
+
+    warmStart(particles, springs, deltaT);
+    steps++;
+    for (unsigned int iteration = 0; iteration < iterations; iteration++)
+    {
+        // chunks of a color start at least MIN_CHUNK apart, so each has a slot of its own
+        fill(chunkResiduals.begin(), chunkResiduals.end(), 0.0f);
+        for (size_t c = 0; c + 1 < colorStarts.size(); c++)
+        {
+            pool.parallelFor(colorStarts[c], colorStarts[c + 1], [&](size_t begin, size_t end) {
+                float largest = 0;
+                for (size_t i = begin; i < end; i++)
+                    largest = max(largest, project(particles, springs[order[i]], lambdas[order[i]], deltaT));
+                float& chunk = chunkResiduals[begin / MIN_CHUNK];
+                chunk = max(chunk, largest);
+            }, MIN_CHUNK);
+        }
+        iterationsRun++;
+
+        if (params.ground)
+        {
+            pool.parallelFor(0, particles.size(), [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++)
+                {
+                    Particle& particle = particles[i];
+                    if (particle.mass > 0 && particle.position.y < params.groundHeight)
+                        particle.position.y = params.groundHeight;
+                }
+            }, MIN_CHUNK);
+        }
+
+        if (tolerance > 0 && *max_element(chunkResiduals.begin(), chunkResiduals.end()) < tolerance)
+            break;
+    }
+
+    pool.parallelFor(0, particles.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            Particle& particle = particles[i];
+            if (particle.mass > 0)
+                particle.velocity = (particle.position - previous[i]) / deltaT;
+            particle.netForce = glm::vec3(0);
+        }
+    }, MIN_CHUNK);
+}
+
+/*
+    One XPBD update of a spring's constraint |p1 - p2| - restLength, with
+    compliance 1 / stiffness and the spring's dampening acting on how fast
+    it has stretched since the start of the step. Returns how far the
+    spring was from satisfying it, relative to its rest length.
+*/
+float XpbdSolver::project(vector<Particle>& particles, const Spring& spring, float& lambda, float deltaT) const
+{
+    Particle& p1 = particles[spring.p1];
+    Particle& p2 = particles[spring.p2];
+    const float w1 = inverseMass(p1);
+    const float w2 = inverseMass(p2);
+    if (w1 + w2 <= 0 || spring.stiffness <= 0)
+        return 0;
+
+    glm::vec3 difference = p1.position - p2.position;
+    float distance = glm::length(difference);
+    if (distance < EPSILON)
+        return 0;
+    glm::vec3 direction = difference / distance;
+
+    const float compliance = 1 / (spring.stiffness * deltaT * deltaT);
+    const float dampening = spring.dampening / (spring.stiffness * deltaT);
+    float stretchRate = glm::dot(direction, (p1.position - previous[spring.p1]) - (p2.position - previous[spring.p2]));
+    float constraint = distance - spring.restLength;
+
+    float residual = -constraint - compliance * lambda - dampening * stretchRate;
+    float deltaLambda = residual / ((1 + dampening) * (w1 + w2) + compliance);
+    if (w1 > 0)
+        p1.position += w1 * deltaLambda * direction;
+    if (w2 > 0)
+        p2.position -= w2 * deltaLambda * direction;
+    lambda += deltaLambda;
+    return abs(residual) / max(spring.restLength, EPSILON);
+}